@@ -0,0 +1,552 @@
+/**
+ * Throughput benchmark for cqg pipeline.
+ *
+ * Generates several input distributions, measures \c Input,
+ * \c ParenthesisChecker kernels, \c MultiParenthesisChecker and the
+ * end-to-end check-parenthesis binary, and reports MB/s and lines/s
+ * as CSV for comparison between commits.
+ */
+#include "BracketScanner.h"
+#include "Input.h"
+#include "MultiParenthesisChecker.h"
+#include "ParenthesisChecker.h"
+#include "StatisticsChecker.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RET_OK                  0
+#define RET_FAILURE             1
+#define RET_INVALID_ARGS        3
+
+#define MB                      (1024. * 1024.)
+
+struct Distribution {
+    const char  *name;
+    size_t      minLineLength;
+    size_t      maxLineLength;
+    double      bracketDensity;
+};
+
+static const Distribution DISTRIBUTIONS[] = {
+    { "tiny-lines",     0,          32,         0.1     },
+    { "long-lines",     10 << 20,   10 << 20,   0.05    },
+    { "bracket-dense",  1024,       8192,       0.5     },
+    { "bracket-sparse", 1024,       8192,       0.001   },
+};
+
+struct Options {
+    size_t      size        = 64 << 20;
+    unsigned    repeat      = 3;
+    unsigned    seed        = 1;
+    const char  *tag        = "current";
+    std::string binary;
+    size_t      threads     = 0;
+};
+
+struct Result {
+    size_t      bytes       = 0;
+    size_t      lines       = 0;
+    double      seconds     = 0.;
+};
+
+static double now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Generate valid lines so that checkers have to scan every byte
+ */
+static std::string generate(const Distribution &dist, size_t size, unsigned seed) {
+    std::string data;
+    unsigned state = seed;
+
+    data.reserve(size + dist.maxLineLength + 1);
+
+    while (data.size() < size) {
+        size_t length = dist.minLineLength;
+        if (dist.maxLineLength > dist.minLineLength) {
+            length += rand_r(&state) % (dist.maxLineLength - dist.minLineLength + 1);
+        }
+
+        size_t depth = 0;
+
+        for (size_t idx = 0; idx < length; ++idx) {
+            double coin = static_cast<double>(rand_r(&state)) / RAND_MAX;
+
+            if (coin >= dist.bracketDensity) {
+                data.push_back('a' + rand_r(&state) % 26);
+            }
+            else if (depth && (rand_r(&state) & 1)) {
+                data.push_back(')');
+                --depth;
+            }
+            else {
+                data.push_back('(');
+                ++depth;
+            }
+        }
+
+        data.append(depth, ')');
+        data.push_back('\n');
+    }
+
+    return data;
+}
+
+static size_t countLines(const std::string &data) {
+    size_t lines = 0;
+
+    for (const char *p = data.data(), *end = p + data.size();
+         (p = reinterpret_cast<const char *>(memchr(p, '\n', end - p)));
+         ++p) {
+        ++lines;
+    }
+
+    return lines;
+}
+
+static bool writeAll(int fd, const char *data, size_t length) {
+    while (length) {
+        ssize_t written = write(fd, data, length);
+
+        if (written < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            return false;
+        }
+
+        data += written;
+        length -= written;
+    }
+
+    return true;
+}
+
+/**
+ * Fork a process writing \c data into a pipe
+ * \return read end of the pipe or -1
+ */
+static int feedPipe(const std::string &data, pid_t *pid) {
+    int fds[2];
+
+    if (pipe(fds) < 0) {
+        return -1;
+    }
+
+    *pid = fork();
+
+    if (*pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    if (!*pid) {
+        close(fds[0]);
+        _exit(writeAll(fds[1], data.data(), data.size()) ? 0 : 1);
+    }
+
+    close(fds[1]);
+
+    return fds[0];
+}
+
+/*** benchmarks ***/
+template <class Checker>
+static Result benchChecker(Checker &checker, const std::string &data) {
+    Result result;
+    const char *p = data.data();
+    const char *end = p + data.size();
+    double start = now();
+
+    while (p < end) {
+        const char *nl = reinterpret_cast<const char *>(memchr(p, '\n', end - p));
+        if (!nl) {
+            nl = end;
+        }
+
+        checker.reset();
+        if (checker.validate(p, nl - p)) {
+            checker.done();
+        }
+
+        ++result.lines;
+        p = nl + 1;
+    }
+
+    result.seconds = now() - start;
+    result.bytes = data.size();
+
+    return result;
+}
+
+static Result benchInput(int fd, Input::Mode mode,
+                         ReadAhead::Backend backend = ReadAhead::Backend::thread) {
+    Result result;
+    Input input(fd, '\n', PIPE_BUF, mode, Input::DEFAULT_MAP_WINDOW,
+                ReadAhead::DEFAULT_BUFFERS, backend);
+    char *line;
+    ssize_t len;
+
+    /* a backend fallen back from is not what is asked to measure */
+    if (Input::Mode::read_ahead == mode &&
+        strcmp(input.stats().readAhead, ReadAhead::backendName(backend))) {
+        result.seconds = -1.;
+        return result;
+    }
+
+    double start = now();
+
+    input.readSizeCeiling(1 << 20);
+    input.start(&line, &len);
+
+    while (true) {
+        bool newLine = input.readAndDetectNewline(&line, &len);
+
+        if (!line) {
+            break;
+        }
+
+        result.bytes += len + newLine;
+        result.lines += newLine;
+    }
+
+    result.seconds = now() - start;
+
+    return result;
+}
+
+static Result benchBinary(const Options &options, const char *path,
+                          const std::string &data, const char *mode) {
+    Result result;
+    pid_t feeder = -1;
+    double start = now();
+    int fd;
+
+    /* the binary would silently fall back to the thread */
+    if (!strcmp(mode, "readahead-io_uring") &&
+        !ReadAhead::supported(ReadAhead::Backend::io_uring)) {
+        result.seconds = -1.;
+        return result;
+    }
+
+    if (!strcmp(mode, "pipe")) {
+        fd = feedPipe(data, &feeder);
+    }
+    else {
+        fd = open(path, O_RDONLY);
+    }
+
+    if (fd < 0) {
+        result.seconds = -1.;
+        return result;
+    }
+
+    pid_t pid = fork();
+
+    if (!pid) {
+        std::string threads = std::to_string(options.threads);
+        int devNull = open("/dev/null", O_WRONLY);
+
+        dup2(fd, STDIN_FILENO);
+        dup2(devNull, STDOUT_FILENO);
+
+        if (!strcmp(mode, "mmap")) {
+            execl(options.binary.c_str(), options.binary.c_str(),
+                  "-i", "mmap", static_cast<char *>(NULL));
+        }
+        else if (!strncmp(mode, "readahead-", 10)) {
+            execl(options.binary.c_str(), options.binary.c_str(),
+                  "-i", "readahead", "-r", mode + 10, static_cast<char *>(NULL));
+        }
+        else if (!strcmp(mode, "parallel")) {
+            execl(options.binary.c_str(), options.binary.c_str(),
+                  "-j", threads.c_str(), static_cast<char *>(NULL));
+        }
+        else {
+            execl(options.binary.c_str(), options.binary.c_str(),
+                  static_cast<char *>(NULL));
+        }
+
+        _exit(127);
+    }
+
+    close(fd);
+
+    int status = 0;
+
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+        !WIFEXITED(status) || 127 == WEXITSTATUS(status)) {
+        result.seconds = -1.;
+    }
+    else {
+        result.seconds = now() - start;
+        result.bytes = data.size();
+        result.lines = countLines(data);
+    }
+
+    if (feeder > 0) {
+        waitpid(feeder, NULL, 0);
+    }
+
+    return result;
+}
+
+/*** report ***/
+static void reportHeader() {
+    std::cout << "tag,distribution,benchmark,variant,bytes,lines,seconds,mb_per_s,lines_per_s"
+              << std::endl;
+}
+
+static void report(const Options &options, const Distribution &dist,
+                   const char *benchmark, const char *variant,
+                   const Result &result) {
+    std::cout << options.tag << ','
+              << dist.name << ','
+              << benchmark << ','
+              << variant << ',';
+
+    if (result.seconds < 0.) {
+        std::cout << "0,0,-1,0,0" << std::endl;
+        return;
+    }
+
+    double seconds = result.seconds > 0. ? result.seconds : 1e-9;
+
+    std::cout << result.bytes << ','
+              << result.lines << ','
+              << result.seconds << ','
+              << result.bytes / MB / seconds << ','
+              << result.lines / seconds
+              << std::endl;
+}
+
+/**
+ * Run \c bench \c repeat times and keep the best one
+ */
+template <class Bench>
+static Result best(unsigned repeat, Bench bench) {
+    Result bestResult;
+
+    for (unsigned idx = 0; idx < repeat; ++idx) {
+        Result result = bench();
+
+        if (!idx || (result.seconds >= 0. && result.seconds < bestResult.seconds)) {
+            bestResult = result;
+        }
+    }
+
+    return bestResult;
+}
+
+static void printUsage(const char *argv0) {
+    std::cerr << "Usage: "
+              << argv0
+              << " [-s megabytes] [-r repeat] [-S seed] [-t tag] [-e binary] [-j threads]"
+              << std::endl
+              << "  -s  data size per distribution, defaults to 64"
+              << std::endl
+              << "  -r  repeat each benchmark and report the best run, defaults to 3"
+              << std::endl
+              << "  -S  data generator seed"
+              << std::endl
+              << "  -t  tag for the report rows e.g. commit id"
+              << std::endl
+              << "  -e  check-parenthesis binary, defaults to ../check-parenthesis"
+              << std::endl
+              << "      relative to this executable"
+              << std::endl
+              << "  -j  threads for parallel end-to-end run, defaults to CPU count"
+              << std::endl;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "s:r:S:t:e:j:"))) {
+        switch (opt) {
+            case 's':
+                options.size = strtoul(optarg, NULL, 0) << 20;
+                break;
+
+            case 'r':
+                options.repeat = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'S':
+                options.seed = strtoul(optarg, NULL, 0);
+                break;
+
+            case 't':
+                options.tag = optarg;
+                break;
+
+            case 'e':
+                options.binary = optarg;
+                break;
+
+            case 'j':
+                options.threads = strtoul(optarg, NULL, 0);
+                break;
+
+            default:
+                printUsage(argv[0]);
+                return RET_INVALID_ARGS;
+        }
+    }
+
+    if (!options.repeat) {
+        options.repeat = 1;
+    }
+
+    if (!options.threads) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        options.threads = cpus > 0 ? cpus : 1;
+    }
+
+    if (options.binary.empty()) {
+        std::string self(argv[0]);
+        options.binary = std::string(dirname(&self[0])) + "/../check-parenthesis";
+    }
+
+    /* a failing feeder must not kill us */
+    signal(SIGPIPE, SIG_IGN);
+
+    const char *tmpDir = getenv("TMPDIR");
+    std::string path = std::string(tmpDir ? tmpDir : "/tmp") + "/cqg-bench.XXXXXX";
+
+    reportHeader();
+
+    for (const Distribution &dist : DISTRIBUTIONS) {
+        std::string data = generate(dist, options.size, options.seed);
+        int fd = mkstemp(&path[0]);
+
+        if (fd < 0 || !writeAll(fd, data.data(), data.size())) {
+            perror("Can't write benchmark data");
+            return RET_FAILURE;
+        }
+
+        close(fd);
+
+        /* checkers on in-memory data */
+        static const BracketScanner::Kernel KERNELS[] = {
+            BracketScanner::Kernel::scalar,
+            BracketScanner::Kernel::sse2,
+            BracketScanner::Kernel::avx2,
+        };
+
+        for (BracketScanner::Kernel kernel : KERNELS) {
+            ParenthesisChecker checker;
+
+            if (!checker.kernel(kernel)) {
+                continue;
+            }
+
+            report(options, dist, "checker", BracketScanner::kernelName(kernel),
+                   best(options.repeat, [&]() {
+                       return benchChecker(checker, data);
+                   }));
+        }
+
+        for (BracketScanner::Kernel kernel : KERNELS) {
+            StatisticsChecker checker;
+
+            if (!checker.kernel(kernel)) {
+                continue;
+            }
+
+            report(options, dist, "statistics-checker", BracketScanner::kernelName(kernel),
+                   best(options.repeat, [&]() {
+                       return benchChecker(checker, data);
+                   }));
+        }
+
+        {
+            MultiParenthesisChecker checker;
+
+            checker.reset("()[]{}<>");
+
+            report(options, dist, "multi-checker", "4-pairs",
+                   best(options.repeat, [&]() {
+                       return benchChecker(checker, data);
+                   }));
+        }
+
+        /* Input alone */
+        static const char *INPUT_MODES[] = {
+            "read", "mmap", "readahead-thread", "readahead-io_uring", "pipe"
+        };
+
+        for (const char *mode : INPUT_MODES) {
+            report(options, dist, "input", mode,
+                   best(options.repeat, [&]() {
+                       Result result;
+                       pid_t feeder = -1;
+                       int in = strcmp(mode, "pipe") ?
+                                    open(path.c_str(), O_RDONLY) :
+                                    feedPipe(data, &feeder);
+
+                       if (in < 0) {
+                           result.seconds = -1.;
+                           return result;
+                       }
+
+                       result = benchInput(in,
+                                           !strcmp(mode, "mmap") ?
+                                               Input::Mode::mmap :
+                                           !strncmp(mode, "readahead-", 10) ?
+                                               Input::Mode::read_ahead :
+                                               Input::Mode::read,
+                                           !strcmp(mode, "readahead-io_uring") ?
+                                               ReadAhead::Backend::io_uring :
+                                               ReadAhead::Backend::thread);
+                       close(in);
+
+                       if (feeder > 0) {
+                           waitpid(feeder, NULL, 0);
+                       }
+
+                       return result;
+                   }));
+        }
+
+        /* the whole binary */
+        static const char *BINARY_MODES[] = {
+            "read", "mmap", "readahead-thread", "readahead-io_uring", "pipe", "parallel"
+        };
+
+        for (const char *mode : BINARY_MODES) {
+            report(options, dist, "end-to-end", mode,
+                   best(options.repeat, [&]() {
+                       return benchBinary(options, path.c_str(), data, mode);
+                   }));
+        }
+
+        unlink(path.c_str());
+        path.replace(path.size() - 6, 6, "XXXXXX");
+    }
+
+    return RET_OK;
+}
@@ -15,5 +15,8 @@ test/test-creator > input 2> output.expected
 cat input | ./check-parenthesis > output.actual || true
 diff -q output.expected output.actual && echo "OK" || echo "Fail"
 
+test/line-index-test
+test/read-ahead-test
+
 popd
 
@@ -0,0 +1,124 @@
+#ifndef BRACKET_SCANNER_H
+# define BRACKET_SCANNER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Block scanner for a single pair of brackets.
+ *
+ * Tracks running nesting depth over a block of characters and
+ * detects the first character which drives the depth below nil.
+ * Vector kernels classify the block into opening/closing bitmasks
+ * and resolve the depth with in-register prefix sums. The kernel
+ * is chosen at runtime depending on CPU features.
+ */
+class BracketScanner {
+public:
+    /*** types ***/
+    enum class Kernel {
+        scalar,
+        sse2,
+        avx2,
+        best,                           /// the best kernel supported by CPU
+    };
+
+    /**
+     * Kernel function.
+     * \param str block start
+     * \param length block length
+     * \param opening open bracket symbol
+     * \param closing closing bracket symbol
+     * \param [in,out] depth running nesting depth
+     * \return index of the first superfluous closing bracket
+     *         or \c length if there is none
+     *
+     * If superfluous bracket is found \c *depth is left equal to nil
+     * i.e. it reflects the state right before the failing character.
+     */
+    typedef size_t (*KernelFunction)(const char *str, size_t length,
+                                     char opening, char closing,
+                                     ssize_t *depth);
+
+    /**
+     * Bracket figures gathered along with the scan
+     */
+    struct Tally {
+        size_t      opening     = 0;    /// opening brackets met
+        size_t      closing     = 0;    /// closing brackets met,
+                                        /// the superfluous one included
+        ssize_t     maxDepth    = 0;    /// maximum nesting depth reached
+    };
+
+    /**
+     * Tallying kernel function.
+     * The same as \c KernelFunction, besides it accumulates
+     * figures of the characters scanned into \c *tally.
+     */
+    typedef size_t (*TallyKernelFunction)(const char *str, size_t length,
+                                          char opening, char closing,
+                                          ssize_t *depth, Tally *tally);
+
+private:
+    /*** data ***/
+    char                _opening;
+    char                _closing;
+    Kernel              _kernel;
+    KernelFunction      _function;
+    TallyKernelFunction _tallyFunction;
+
+public:
+    /*** API ***/
+    BracketScanner(char opening = '(',
+                   char closing = ')',
+                   Kernel kernel = Kernel::best);
+
+    /**
+     * Change bracket pair
+     */
+    void brackets(char opening, char closing) {
+        _opening = opening;
+        _closing = closing;
+    }
+
+    /**
+     * Select kernel
+     * \return \c false if the kernel is not supported by CPU.
+     *         The kernel is not changed then.
+     */
+    bool kernel(Kernel k);
+
+    Kernel kernel() const {
+        return _kernel;
+    }
+
+    /**
+     * Scan the block.
+     * See \c KernelFunction for description.
+     */
+    size_t scan(const char *str, size_t length, ssize_t *depth) const {
+        return _function(str, length, _opening, _closing, depth);
+    }
+
+    /**
+     * Scan the block gathering figures in the same pass.
+     * See \c TallyKernelFunction for description.
+     */
+    size_t scan(const char *str, size_t length, ssize_t *depth, Tally *tally) const {
+        return _tallyFunction(str, length, _opening, _closing, depth, tally);
+    }
+
+    /**
+     * Check if the kernel is supported by CPU
+     */
+    static bool supported(Kernel k);
+
+    /**
+     * Resolve \c Kernel::best to an actual kernel
+     */
+    static Kernel bestKernel();
+
+    static const char *kernelName(Kernel k);
+};
+
+#endif /* BRACKET_SCANNER_H */
@@ -0,0 +1,102 @@
+#ifndef BRACKET_STACK_H
+# define BRACKET_STACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * Compact stack of bracket pair indices.
+ *
+ * The first \c INLINE_SIZE entries live right in the object
+ * so that typical nesting never leaves the cache lines of the
+ * checker. Deeper nesting spills to an arena of fixed-size chunks
+ * which are kept allocated for reuse until the stack is destroyed.
+ */
+class BracketStack {
+public:
+    static const size_t INLINE_SIZE = 1024;
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+private:
+    /*** data ***/
+    uint8_t                 _inline[INLINE_SIZE];
+    std::vector<uint8_t *>  _chunks;
+    size_t                  _size;
+
+    uint8_t *_slot(size_t idx) {
+        if (idx < INLINE_SIZE) {
+            return _inline + idx;
+        }
+
+        idx -= INLINE_SIZE;
+
+        return _chunks[idx / CHUNK_SIZE] + idx % CHUNK_SIZE;
+    }
+
+public:
+    /*** API ***/
+    BracketStack();
+    ~BracketStack();
+
+    BracketStack(const BracketStack &) = delete;
+    BracketStack &operator=(const BracketStack &) = delete;
+
+    /**
+     * Push an entry
+     * \return \c false if arena chunk allocation failed
+     */
+    bool push(uint8_t value) {
+        if (_size >= INLINE_SIZE &&
+            (_size - INLINE_SIZE) / CHUNK_SIZE >= _chunks.size() &&
+            !_grow()) {
+            return false;
+        }
+
+        *_slot(_size++) = value;
+
+        return true;
+    }
+
+    /**
+     * Pop an entry. The stack must not be empty.
+     */
+    uint8_t pop() {
+        return *_slot(--_size);
+    }
+
+    /**
+     * Fetch the top entry. The stack must not be empty.
+     */
+    uint8_t top() {
+        return *_slot(_size - 1);
+    }
+
+    bool empty() const {
+        return !_size;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    /**
+     * Empty the stack, arena chunks are retained
+     */
+    void clear() {
+        _size = 0;
+    }
+
+    /**
+     * Number of arena chunks allocated
+     */
+    size_t chunks() const {
+        return _chunks.size();
+    }
+
+private:
+    bool _grow();
+};
+
+#endif /* BRACKET_STACK_H */
@@ -8,24 +8,62 @@
  * Buffer class.
  * Implements non-shrinkable policy buffer i.e. tries to only expand
  * and thus --- reduces realloc calls and memory fragmentation.
+ *
+ * How much to expand by is defined with growth policy.
+ * A pooled buffer takes its block from and returns it to
+ * the thread-local \c BufferPool.
  */
 class Buffer {
+public:
+    /*** types ***/
+    enum class Growth {
+        exact,                                              ///< expand to exactly requested size
+        geometric,                                          ///< at least double the size
+        page_aligned,                                       ///< geometric, page-aligned and rounded
+                                                            ///< up to page size; blocks not less
+                                                            ///< than \c HUGE_PAGE_SIZE are aligned
+                                                            ///< to it and advised for huge pages
+        _count
+    };
+
+    static const size_t HUGE_PAGE_SIZE = 2 << 20;
+
 protected:
+    typedef size_t (*GrowthFunction)(size_t size, size_t newSize);
+
+    static const GrowthFunction GROWTH[static_cast<size_t>(Growth::_count)];
+
     size_t _size;                                           ///< allocated size
     size_t _userSize;                                       ///< size to report to user
     void *_data;                                            ///< allocated block
     off_t _offset;
     bool _invalid;
+    Growth _growth;
+    bool _pooled;
 
     void _deallocate();
 
+    /**
+     * Allocate a block according to growth policy
+     * \param [in,out] size requested size, updated to real size
+     */
+    void *_allocate(size_t *size) const;
+
+    static size_t _growExact(size_t size, size_t newSize);
+    static size_t _growGeometric(size_t size, size_t newSize);
+    static size_t _growPageAligned(size_t size, size_t newSize);
+
 public:
     /**
      * C-tor
      * \param initialSize initial buffer size
+     * \param growth growth policy
+     * \param pooled whether to use thread-local \c BufferPool
      * Nil initial size is permitted
      */
-    Buffer(size_t initialSize = 0);
+    Buffer(size_t initialSize = 0,
+           Growth growth = Growth::exact,
+           bool pooled = false);
     Buffer(size_t userSize, size_t realSize, void *data);
     Buffer(size_t userSize, size_t realSize, void *data, off_t offset);
     ~Buffer();
@@ -67,6 +105,14 @@ public:
     off_t offset(void) const;
     bool offset(off_t off);
     bool shift(off_t sft);
+
+    Growth growth() const {
+        return _growth;
+    }
+
+    bool pooled() const {
+        return _pooled;
+    }
 };
 
 #endif /* BUFFER_H */
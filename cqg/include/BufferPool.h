@@ -0,0 +1,58 @@
+#ifndef BUFFER_POOL_H
+# define BUFFER_POOL_H
+
+#include <stddef.h>
+
+/**
+ * Thread-local free list of memory blocks for \c Buffer.
+ *
+ * Pooled buffers take their blocks from here and give them
+ * back upon destruction instead of going to malloc and free.
+ * Each thread owns its own list so no locking is involved.
+ * A block is recycled only if the list has room for it,
+ * otherwise it is freed. Blocks left are freed at thread exit,
+ * blocks released after that go straight to free.
+ */
+class BufferPool {
+public:
+    /*** types ***/
+    struct Stats {
+        size_t      hits        = 0;    /// blocks taken from the list
+        size_t      misses      = 0;    /// requests with nothing suitable
+        size_t      recycled    = 0;    /// blocks put to the list
+        size_t      dropped     = 0;    /// blocks freed as the list was full
+        size_t      entries     = 0;    /// blocks in the list
+        size_t      bytes       = 0;    /// bytes in the list
+    };
+
+    static const size_t MAX_ENTRIES = 16;
+    static const size_t MAX_BYTES = 64 << 20;
+
+    /**
+     * Take the smallest block of at least \c size bytes
+     * \param size minimal block size
+     * \param aligned whether the block must be page-aligned
+     * \param [out] realSize the block size
+     * \return the block or \c NULL if there is no suitable one
+     */
+    static void *acquire(size_t size, bool aligned, size_t *realSize);
+
+    /**
+     * Put a block to the list
+     * \return \c false if the list is full or already destroyed
+     *         at thread exit, the block is freed then
+     */
+    static bool recycle(void *data, size_t realSize, bool aligned);
+
+    /**
+     * Free every block of the calling thread
+     */
+    static void purge();
+
+    /**
+     * Statistics of the calling thread
+     */
+    static Stats stats();
+};
+
+#endif /* BUFFER_POOL_H */
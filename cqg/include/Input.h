@@ -2,26 +2,126 @@
 #define INPUT_H
 
 #include "Buffer.h"
+#include "LineIndex.h"
+#include "ReadAhead.h"
 
 #include <sys/types.h>
 #include <linux/limits.h>
 
+#include <memory>
+
 /**
  * Input stream representation with variable delimiter
  */
 class Input {
+public:
+    /*** types ***/
+    /**
+     * Input mode
+     */
+    enum class Mode {
+        read,                           /// read (2) into internal buffer
+        mmap,                           /// map regular file into memory,
+                                        /// falls back to \c read for
+                                        /// anything but regular files
+        read_ahead,                     /// reads on io_uring or a background
+                                        /// thread into a ring of buffers
+                                        /// while the previous chunk is
+                                        /// processed, see \c ReadAhead
+    };
+
+    /**
+     * Default limit of address space mapped at once
+     */
+    static const size_t DEFAULT_MAP_WINDOW = static_cast<size_t>(1) << 30;
+
+    /**
+     * Number of consecutive full reads to double the read size after
+     */
+    static const unsigned FULL_READS_TO_GROW = 2;
+
+    /**
+     * Input statistics
+     */
+    struct Stats {
+        size_t      syscalls        = 0;    /// read (2) or mmap (2) calls issued
+        size_t      bytes           = 0;    /// bytes delivered
+        size_t      fullReads       = 0;    /// reads which filled the buffer up
+        size_t      readSize        = 0;    /// current read size
+        ssize_t     pipeCapacity    = -1;   /// pipe capacity, negative if
+                                            /// the input is not a pipe
+        size_t      skippedBytes    = 0;    /// bytes discarded with \c skipLine
+        const char  *readAhead      = NULL; /// read-ahead backend in use,
+                                            /// nil if not \c Mode::read_ahead
+
+        double syscallsPerByte() const {
+            return bytes ? static_cast<double>(syscalls) / bytes : 0.;
+        }
+    };
+
 private:
     int             _fd;
     char            _delim;
     char            *_prevNewline;
     Buffer          _buffer;
     size_t          _maxBufferSize;
+    size_t          _readSizeCeiling;   ///< limit for read size growth
+    unsigned        _consecutiveFullReads;
+    Mode            _mode;
+    Stats           _stats;
+
+    char            *_blockStart;       ///< current block start
+    char            *_blockEnd;         ///< current block end
+
+    /* mmap mode */
+    void            *_map;              ///< current mapping window
+    size_t          _mapLength;         ///< current mapping window length
+    size_t          _maxMapSize;        ///< mapping window length limit
+    off_t           _fileOffset;        ///< file offset to map next window at
+    off_t           _fileSize;          ///< file size known so far
+
+    /* read-ahead mode */
+    std::unique_ptr<ReadAhead>  _readAhead;
+
+    /**
+     * Account a read of \c readCount bytes and grow read size
+     */
+    void _accountRead(size_t readCount, size_t readSize);
+
+    /**
+     * Take another chunk from the read-ahead ring
+     */
+    ssize_t _readAheadBlock();
 
     /**
      * Read another chunk and reset \c _prevNewline to its start
+     * \param readSize amount to read for \c Mode::read
      * \return the same as \c read (2) does including with errno values
      */
-    ssize_t _readAnotherBlock();
+    ssize_t _readAnotherBlock(size_t readSize);
+
+    /**
+     * Read another chunk with \c read (2)
+     */
+    ssize_t _readBlock(size_t readSize);
+
+    /**
+     * Slide the mapping window further through the file
+     */
+    ssize_t _mapBlock();
+
+    /**
+     * Check if \c _fd is a regular file and prepare mapping
+     * \return \c false if the mapping can't be employed
+     */
+    bool _setupMapping();
+
+    void _unmap();
+
+    /**
+     * Drop the current chunk so that the next call reads another one
+     */
+    void _resetBlock();
 
 public:
     /**
@@ -34,22 +134,88 @@ public:
      * \param fd input file descriptor
      * \param delim delimiter character
      * \param initialBufferSize initial input buffer size, will increased by 1
+     * \param mode input mode
+     * \param maxMapSize mapping window length limit for \c Mode::mmap,
+     *                   rounded to page size
+     * \param readAheadBuffers number of buffers for \c Mode::read_ahead,
+     *                         2 for double buffering, 3 for triple etc.
+     * \param readAheadBackend preferred backend for \c Mode::read_ahead,
+     *                         see \c stats for the one in use
+     *
+     * With \c Mode::mmap chunks point straight into the mapping
+     * and are read-only. Files larger than \c maxMapSize are mapped
+     * with a sliding window. Truncating the file while it is being
+     * read results in \c SIGBUS.
+     *
+     * With \c Mode::read_ahead a chunk stays valid until the next
+     * call only, its buffer is then handed back to be refilled.
      */
     Input(int fd,
           char delim = '\n',
-          size_t maxBufferSize = PIPE_BUF);
+          size_t maxBufferSize = PIPE_BUF,
+          Mode mode = Mode::read,
+          size_t maxMapSize = DEFAULT_MAP_WINDOW,
+          size_t readAheadBuffers = ReadAhead::DEFAULT_BUFFERS,
+          ReadAhead::Backend readAheadBackend = ReadAhead::Backend::io_uring);
     ~Input();
 
-    Input(Input &&rhs) = default;
+    Input(Input &&rhs);
     Input(const Input &rhs) = delete;
 
-    Input &operator=(Input &&rhs) = default;
+    Input &operator=(Input &&rhs);
     Input &operator=(const Input &rhs) = delete;
 
     int fd() const {
         return _fd;
     }
 
+    /**
+     * Actual input mode i.e. after falling back to \c Mode::read
+     */
+    Mode mode() const {
+        return _mode;
+    }
+
+    const Stats &stats() const {
+        return _stats;
+    }
+
+    /**
+     * Let read size grow adaptively.
+     * \param ceiling read size limit
+     * \return \c false if pipe capacity couldn't be enlarged
+     *
+     * Read size starts at \c maxBufferSize and is doubled
+     * whenever \c FULL_READS_TO_GROW consecutive reads fill
+     * the whole buffer up until it reaches \c ceiling.
+     * If the input is a pipe its capacity is enlarged up to
+     * \c ceiling with \c F_SETPIPE_SZ. Unprivileged user
+     * is limited with /proc/sys/fs/pipe-max-size.
+     */
+    bool readSizeCeiling(size_t ceiling);
+
+    size_t readSizeCeiling() const {
+        return _readSizeCeiling;
+    }
+
+    /**
+     * Reposition the input to \c offset in the file
+     * \return \c false on failure, see \c errno for error code
+     *
+     * Chunks previously returned become invalid.
+     * The input must be seekable.
+     */
+    bool seek(off_t offset);
+
+    /**
+     * Reposition the input to the start of line \c line
+     * \param index line index of the file
+     * \param line line number, starting with 1
+     * \return \c false on failure, \c ERANGE if the index
+     *         has no such line
+     */
+    bool seekLine(const LineIndex &index, size_t line);
+
     /**
      * Notify the instance that user is about to start reading.
      * The same rules as for \c readAndDetectNewline
@@ -91,6 +257,17 @@ public:
     bool readUntilNewline(char **line,
                           ssize_t *len,
                           bool alreadyNewLine);
+
+    /**
+     * Discard the rest of the current line.
+     * \return \c true if the delimiter was found, \c false on EOF
+     *         or read failure, see \c errno then
+     *
+     * Only the delimiter is searched for, no chunks are surfaced.
+     * Reads are done with the read size ceiling at once, in
+     * \c Mode::mmap the whole mapping window is searched.
+     */
+    bool skipLine();
 };
 
 #endif /* INPUT_H */
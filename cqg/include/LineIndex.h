@@ -0,0 +1,121 @@
+#ifndef LINE_INDEX_H
+# define LINE_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <vector>
+
+/**
+ * Line offset index of a regular file.
+ *
+ * Line lengths, delimiter included, are stored as LEB128 varints
+ * so that a typical index takes a byte or two per line. Every
+ * \c CHECKPOINT_INTERVAL lines an absolute offset is kept to look
+ * lines up without decoding the whole index.
+ *
+ * The index is persisted in a sidecar file keyed by size and
+ * modification time of the indexed file, a stale sidecar is
+ * refused upon load. The sidecar uses host byte order.
+ *
+ * Typical usage:
+ * \code
+ * LineIndex index;
+ * if (!index.load(sidecar, fd)) {
+ *     index.build(fd) && index.save(sidecar);
+ * }
+ * off_t offset = index.offset(line);
+ * \endcode
+ */
+class LineIndex {
+public:
+    /*** types ***/
+    static const size_t CHECKPOINT_INTERVAL = 1024;
+
+private:
+    struct Checkpoint {
+        uint64_t    offset;                 /// line start in the file
+        uint64_t    position;               /// varint position in \c _deltas
+    };
+
+    /*** data ***/
+    char                    _delim;
+    size_t                  _lines;         ///< delimiters met
+    uint64_t                _fileSize;
+    int64_t                 _mtimeSec;
+    int64_t                 _mtimeNsec;
+    std::vector<uint8_t>    _deltas;
+    std::vector<Checkpoint> _checkpoints;
+
+    void _clear();
+    void _append(uint64_t delta, uint64_t start);
+
+    /**
+     * Whether size and modification time of \c fd match the index
+     */
+    bool _matches(int fd) const;
+
+    /**
+     * Whether checkpoints are ordered and within the file and \c _deltas
+     */
+    bool _valid() const;
+
+public:
+    /*** API ***/
+    /**
+     * c-tor
+     * \param delim line delimiter
+     */
+    LineIndex(char delim = '\n');
+
+    /**
+     * Index the whole file
+     * \param fd file descriptor of a regular file,
+     *           its offset is left intact
+     * \return \c false on failure, see \c errno for error code
+     */
+    bool build(int fd);
+
+    /**
+     * Write the index to the sidecar
+     * \return \c false on failure, see \c errno for error code
+     *
+     * The sidecar is replaced atomically with \c rename (2).
+     */
+    bool save(const char *path) const;
+
+    /**
+     * Read the index from the sidecar
+     * \param path sidecar path
+     * \param fd the indexed file
+     * \return \c false on failure, see \c errno for error code,
+     *         \c ESTALE if the sidecar doesn't match the file
+     *         or delimiter, \c EINVAL if it is malformed
+     */
+    bool load(const char *path, int fd);
+
+    /**
+     * Number of delimited lines
+     */
+    size_t lines() const {
+        return _lines;
+    }
+
+    /**
+     * Line start
+     * \param line line number, starting with 1, up to \c lines() + 1
+     *             for the data after the last delimiter
+     * \return offset in the file or \c -1 if out of range
+     *         or the index is damaged
+     */
+    off_t offset(size_t line) const;
+
+    /**
+     * Number of the line \c offset belongs to,
+     * \c lines() + 1 past the last delimiter
+     */
+    size_t lineAt(off_t offset) const;
+};
+
+#endif /* LINE_INDEX_H */
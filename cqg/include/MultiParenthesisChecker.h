@@ -0,0 +1,118 @@
+#ifndef MULTI_PARENTHESIS_CHECKER_H
+# define MULTI_PARENTHESIS_CHECKER_H
+
+#include "BracketStack.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * Parenthesis checker for a set of bracket pairs
+ * e.g. "()[]{}<>" validated together in a single pass
+ * with proper nesting, i.e. "([)]" is invalid.
+ *
+ * The usage is the same as for \c ParenthesisChecker:
+ * \code
+ * checker.reset("()[]");
+ * while (input file has another line) {
+ *     bool result = true;
+ *     while (result && read block of line) {
+ *         result = checker.validate(block.start, block.length);
+ *     }
+ *     result = result && checker.done();
+ *     checker.reset();
+ * }
+ * \endcode
+ *
+ * Open brackets are kept on \c BracketStack.
+ */
+class MultiParenthesisChecker {
+public:
+    /*** types ***/
+    enum class Failure {
+        none,
+        superfluous,                    /// closing bracket with nothing open
+        mismatch,                       /// closing bracket of another pair
+        lack,                           /// open brackets left at the line end
+        no_memory,                      /// nesting is too deep to store
+    };
+
+    struct Context {
+        ssize_t     openIndex   = 0;    /// number of open brackets
+        size_t      position    = 0;    /// position in the line,
+                                        /// the failing character included
+        Failure     failure     = Failure::none;
+        char        expected    = '\0'; /// closing bracket expected
+                                        /// for \c Failure::mismatch
+                                        /// and \c Failure::lack
+    };
+
+    /**
+     * Maximum number of bracket pairs
+     */
+    static const size_t MAX_PAIRS = 127;
+
+private:
+    /*** data ***/
+    /**
+     * Character class:
+     * nil for non-bracket, pair index + 1 for opening bracket
+     * and negated pair index - 1 for closing one
+     */
+    int8_t          _class[256];
+    char            _closing[MAX_PAIRS];
+    BracketStack    _stack;
+    Context         _context;
+
+public:
+    /*** API ***/
+    /**
+     * c-tor
+     * Defaults to a single pair "()"
+     */
+    MultiParenthesisChecker();
+    ~MultiParenthesisChecker();
+
+    /**
+     * Configure bracket pairs and reset the checker
+     * \param pairs opening and closing brackets one pair after another
+     * \return \c false if \c pairs has odd length, too many pairs
+     *         or a character is used twice.
+     *
+     * If reset fails the state of the checker is not changed.
+     */
+    bool reset(const char *pairs);
+
+    /**
+     * Reset the checker keeping the bracket pairs
+     */
+    void reset();
+
+    /**
+     * The same as \c reset, for uniformity with \c ParenthesisChecker
+     */
+    void restart() {
+        reset();
+    }
+
+    /**
+     * Validate the block
+     * \param str block start
+     * \param length block length
+     * \return \c true if block is still valid
+     */
+    bool validate(const char *str, size_t length);
+
+    /**
+     * Notify the checker that the line is finished.
+     * \return \c true if there are no open brackets left
+     */
+    bool done();
+
+    const Context& getContext() const {
+        return _context;
+    }
+};
+
+#endif /* MULTI_PARENTHESIS_CHECKER_H */
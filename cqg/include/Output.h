@@ -0,0 +1,111 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "Buffer.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+
+/**
+ * Buffered output stream.
+ *
+ * Text is formatted into a reusable buffer, integers are converted
+ * without any locale involved. The buffer is flushed with a single
+ * \c write (2) call once it reaches flush size, every \c flushLines
+ * lines if requested and upon destruction.
+ */
+class Output {
+public:
+    static const size_t DEFAULT_FLUSH_SIZE = 64 * 1024;
+
+private:
+    int             _fd;
+    Buffer          _buffer;
+    size_t          _flushSize;
+    size_t          _flushLines;
+    size_t          _lines;             ///< lines since the last flush
+    bool            _failed;
+    int             _error;             ///< errno of the failed write
+
+    char *_tail() {
+        return reinterpret_cast<char *>(_buffer.data()) + _buffer.offset();
+    }
+
+    /**
+     * Write \c length bytes from \c data out
+     */
+    bool _write(const char *data, size_t length);
+
+public:
+    /**
+     * Constructor
+     * \param fd output file descriptor
+     * \param flushSize amount of data to flush at
+     * \param flushLines flush every this many lines, nil to flush
+     *                   only when the buffer is full
+     */
+    Output(int fd,
+           size_t flushSize = DEFAULT_FLUSH_SIZE,
+           size_t flushLines = 0);
+    ~Output();
+
+    Output(const Output &rhs) = delete;
+    Output &operator=(const Output &rhs) = delete;
+
+    /**
+     * Append data
+     * Data larger than flush size is written out right away
+     */
+    Output &append(const char *str, size_t length);
+
+    Output &append(const char *str) {
+        return append(str, strlen(str));
+    }
+
+    Output &append(char chr) {
+        return append(&chr, 1);
+    }
+
+    /**
+     * Append decimal representation of the number
+     */
+    Output &append(size_t number);
+
+    /**
+     * Append a newline and flush if \c flushLines lines
+     * were appended since the last flush
+     * \return \c false on write failure
+     */
+    bool endLine();
+
+    /**
+     * Write buffered data out
+     * \return \c false on write failure, see \c errno for error code
+     */
+    bool flush();
+
+    /**
+     * Check if any write has failed
+     */
+    bool failed() const {
+        return _failed;
+    }
+
+    /**
+     * \c errno value of the failed write
+     */
+    int error() const {
+        return _error;
+    }
+
+    size_t flushSize() const {
+        return _flushSize;
+    }
+
+    size_t flushLines() const {
+        return _flushLines;
+    }
+};
+
+#endif /* OUTPUT_H */
@@ -0,0 +1,169 @@
+#ifndef PARALLEL_CHECKER_H
+# define PARALLEL_CHECKER_H
+
+#include "BracketScanner.h"
+#include "Buffer.h"
+#include "LineIndex.h"
+#include "ParenthesisChecker.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Line-parallel parenthesis checker for a single pair of brackets.
+ *
+ * The input is read in large blocks which are scanned on a worker pool.
+ * Lines fully contained in a block are resolved by the worker right away.
+ * A line spanning several blocks is resolved while stitching blocks in order
+ * with per-segment summaries: the number of superfluous closing brackets
+ * met when the depth is reset to nil on each of them and the depth left
+ * at the end of the segment. Given incoming depth \c d the segment fails
+ * if there are more than \c d superfluous brackets, only then the segment
+ * is rescanned to find the exact position.
+ *
+ * Results are reported with a callback in strict line order with the very
+ * same \c Context values as \c ParenthesisChecker would provide when driven
+ * with \c Input line by line. The last line lacking a delimiter is reported
+ * only if it has a superfluous closing bracket.
+ */
+class ParallelChecker {
+public:
+    /*** types ***/
+    /**
+     * Line result callback
+     * \param line line number, starting with 1
+     * \param isValid whether the line is valid
+     * \param ctx checker context at the point of failure or at the line end
+     */
+    typedef std::function<void(size_t line,
+                               bool isValid,
+                               const ParenthesisChecker::Context &ctx)> LineCallback;
+
+    static const size_t DEFAULT_BLOCK_SIZE = 4 << 20;
+
+private:
+    /**
+     * Summary of a line segment
+     */
+    struct Segment {
+        size_t      length      = 0;
+        size_t      failures    = 0;    /// superfluous brackets with depth reset
+        ssize_t     depth       = 0;    /// depth at the end with depth reset
+    };
+
+    struct LineOutcome {
+        bool                        valid;
+        ParenthesisChecker::Context context;
+    };
+
+    struct Block {
+        Buffer                      data;
+        size_t                      length      = 0;
+        bool                        hasNewline  = false;
+        bool                        done        = false;
+
+        Segment                     head;       /// up to the first delimiter
+                                                /// or the whole block
+        std::vector<LineOutcome>    lines;      /// lines fully within the block
+        bool                        tailFailed  = false;
+        ParenthesisChecker::Context tail;       /// after the last delimiter
+
+        Block(size_t size)
+        : data(size, Buffer::Growth::page_aligned, true) {}
+    };
+
+    /*** data ***/
+    char                                _delim;
+    size_t                              _blockSize;
+    BracketScanner                      _scanner;
+    std::vector<std::unique_ptr<Block>> _blocks;
+    std::vector<std::thread>            _workers;
+
+    std::mutex                          _mutex;
+    std::condition_variable             _taskCv;
+    std::condition_variable             _doneCv;
+    std::deque<Block *>                 _tasks;
+    bool                                _stop;
+
+    /* stitching state */
+    size_t                              _line;
+    bool                                _lineFailed;
+    ParenthesisChecker::Context         _context;
+
+    /*** functions ***/
+    void _worker();
+    void _analyze(Block *block) const;
+    Segment _summarize(const char *str, size_t length) const;
+
+    /**
+     * Fill the block up with \c length bytes from \c fd
+     * \return the same as \c read (2)
+     */
+    ssize_t _fill(int fd, Block *block, size_t length);
+
+    /**
+     * Length of the block starting at \c offset so that
+     * it ends on a line boundary if \c index has one in reach
+     */
+    size_t _blockLength(const LineIndex *index, off_t offset) const;
+
+    void _stitch(Block *block, const LineCallback &callback);
+    void _continueLine(const char *str, const Segment &segment,
+                       const LineCallback &callback);
+    void _finishLine(const LineCallback &callback);
+
+public:
+    /*** API ***/
+    /**
+     * c-tor
+     * \param threads worker thread count, at least one is started
+     * \param blockSize input block size
+     * \param delim line delimiter
+     */
+    ParallelChecker(size_t threads,
+                    size_t blockSize = DEFAULT_BLOCK_SIZE,
+                    char delim = '\n');
+    ~ParallelChecker();
+
+    ParallelChecker(const ParallelChecker &) = delete;
+    ParallelChecker &operator=(const ParallelChecker &) = delete;
+
+    /**
+     * Reset the checker
+     * The same rules as for \c ParenthesisChecker::reset apply
+     */
+    bool reset(char opening = '(',
+               char closing = ')');
+
+    /**
+     * Check every line from \c fd till EOF
+     * \param fd input file descriptor
+     * \param callback line result callback
+     * \param index line index of the file, blocks are split on exact
+     *              line boundaries then so that no line but one longer
+     *              than the block spans several blocks
+     * \return \c false on read failure, see \c errno for error code
+     *
+     * Lines read before the failure are reported anyway.
+     */
+    bool run(int fd, const LineCallback &callback,
+             const LineIndex *index = NULL);
+
+    /**
+     * Number of the line being processed i.e. the one
+     * read failure has happened at
+     */
+    size_t line() const {
+        return _line;
+    }
+};
+
+#endif /* PARALLEL_CHECKER_H */
@@ -1,6 +1,8 @@
 #ifndef PARENTHESIS_CHECKER_H
 # define PARENTHESIS_CHECKER_H
 
+#include "BracketScanner.h"
+
 #include <stddef.h>
 #include <stdlib.h>
 
@@ -25,6 +27,9 @@
  * is only a single failure reason: there is closing bracket
  * while checker is wating for the opening one.
  *
+ * Blocks are scanned with \c BracketScanner which picks
+ * a vectorized kernel at runtime if CPU supports one.
+ *
  * Typical usage:
  * \code
  * bool result = true;
@@ -51,25 +56,11 @@ public:
     };
 
 private:
-    enum class State {
-        wait_for_open,
-        wait_for_any,
-        finish          = wait_for_open,    /// the only valid state after
-                                            /// a call to \c done
-    };
-
     /*** data ***/
-    char    _opening;
-    char    _closing;
-    State   _state;
-    Context _context;
-
-   /*** functions ***/
-   bool _validateWaitForOpen(char chr);
-   bool _validateWaitForAny(char chr);
-
-   void _opened();
-   void _closed();
+    char            _opening;
+    char            _closing;
+    BracketScanner  _scanner;
+    Context         _context;
 
 public:
     /*** API ***/
@@ -94,6 +85,13 @@ public:
     bool reset(char opening = '(',
                char closing = ')');
 
+    /**
+     * Reset the state for another line keeping the brackets
+     */
+    void restart() {
+        _context = Context();
+    }
+
     /**
      * Validate the block
      * \param str block start
@@ -112,6 +110,18 @@ public:
     const Context& getContext() const {
         return _context;
     }
+
+    /**
+     * Select scanning kernel.
+     * \return \c false if the kernel isn't supported by CPU
+     */
+    bool kernel(BracketScanner::Kernel k) {
+        return _scanner.kernel(k);
+    }
+
+    BracketScanner::Kernel kernel() const {
+        return _scanner.kernel();
+    }
 };
 
 #endif /* PARENTHESIS_CHECKER_H */
@@ -0,0 +1,198 @@
+#ifndef READ_AHEAD_H
+# define READ_AHEAD_H
+
+#include "Buffer.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Read-ahead over a ring of buffers.
+ *
+ * Every buffer not held by the consumer is being filled from \c fd
+ * so that the data is already there while the previous block is
+ * being validated. Two buffers give double buffering, three ---
+ * triple and so on.
+ *
+ * With \c Backend::io_uring the reads are submitted to an io_uring
+ * driven with raw system calls, no thread is involved. A regular file
+ * has a read in flight for every free buffer, each at its own offset,
+ * and the file position is left intact. Pipes, sockets and the like
+ * have a single read in flight so that blocks come in order.
+ * If the kernel refuses io_uring (\c ENOSYS, \c EPERM with
+ * io_uring disabled or filtered out) the thread backend is used.
+ *
+ * With \c Backend::thread a background thread keeps reading with
+ * \c read (2), it is started upon the first \c next call. It waits
+ * for the descriptor with \c poll (2) along with an \c eventfd (2)
+ * so that destruction doesn't hang on an idle pipe.
+ */
+class ReadAhead {
+public:
+    /*** types ***/
+    static const size_t DEFAULT_BUFFERS = 2;
+
+    enum class Backend {
+        thread,                         /// read (2) on a background thread
+        io_uring,                       /// reads in flight on an io_uring
+    };
+
+private:
+    struct Block {
+        Buffer      data;
+        ssize_t     length      = 0;    /// the same as \c read (2) returned
+        size_t      requested   = 0;    /// read size asked for
+        int         error       = 0;
+
+        /* io_uring backend */
+        struct iovec iov;
+        off_t       offset      = 0;    /// file offset, -1 for streams
+        unsigned    generation  = 0;    /// \c _generation when submitted
+        bool        completed   = false;
+
+        Block()
+        : data(1, Buffer::Growth::page_aligned) {}
+    };
+
+    /**
+     * Mapped io_uring, see ReadAhead.cpp
+     */
+    struct Ring;
+
+    /*** data ***/
+    int                                 _fd;
+    int                                 _wakeFd;
+    size_t                              _readSize;
+    std::vector<std::unique_ptr<Block>> _blocks;
+    Block                               *_current;
+
+    std::thread                         _reader;
+    std::mutex                          _mutex;
+    std::condition_variable             _freeCv;
+    std::condition_variable             _filledCv;
+    std::deque<Block *>                 _free;
+    std::deque<Block *>                 _filled;
+    bool                                _stop;
+
+    /* io_uring backend */
+    std::unique_ptr<Ring>               _ring;
+    std::deque<Block *>                 _submitted;     ///< in submission order
+    off_t                               _offset;        ///< of the next read,
+                                                        ///< negative for streams
+    unsigned                            _generation;    ///< bumped to discard the
+                                                        ///< reads in flight
+    unsigned                            _queued;        ///< entries not submitted
+    size_t                              _inFlight;      ///< reads not completed
+    bool                                _started;
+    bool                                _pollFirst;     ///< the stream is non-blocking
+    int                                 _error;         ///< sticky failure
+
+    /*** functions ***/
+    /**
+     * Map an io_uring of \c entries entries
+     * \return \c false if the kernel refuses it, see errno
+     */
+    bool _setupRing(unsigned entries);
+
+    /**
+     * Queue reads into the free blocks
+     * \return \c false if a buffer couldn't be grown
+     */
+    bool _fill();
+
+    /**
+     * Submit the queued entries and wait for \c minComplete
+     * completions, then take the completions
+     * \return \c false on failure, see errno
+     */
+    bool _enter(unsigned minComplete);
+
+    /**
+     * Give the completed reads back to their blocks
+     */
+    void _reap();
+
+    /**
+     * \c next for the io_uring backend
+     */
+    ssize_t _nextCompleted(char **data, size_t *requested);
+
+    /**
+     * Cancel the reads in flight and wait for them
+     */
+    void _cancel();
+
+    /**
+     * Report \c _current
+     */
+    ssize_t _deliver(char **data, size_t *requested);
+
+    void _read();
+
+    /**
+     * Wait for \c _fd to become readable and read
+     * \return the same as \c read (2), \c -1 with \c ECANCELED
+     *         if woken up by destruction
+     */
+    ssize_t _readBlock(Block *block, size_t readSize);
+
+public:
+    /*** API ***/
+    /**
+     * c-tor
+     * \param fd input file descriptor
+     * \param buffers number of buffers, at least one
+     * \param readSize initial read size
+     * \param backend preferred backend, see \c backend for the actual one
+     */
+    ReadAhead(int fd, size_t buffers, size_t readSize,
+              Backend backend = Backend::io_uring);
+    ~ReadAhead();
+
+    ReadAhead(const ReadAhead &) = delete;
+    ReadAhead &operator=(const ReadAhead &) = delete;
+
+    size_t buffers() const {
+        return _blocks.size();
+    }
+
+    /**
+     * Backend in use i.e. after falling back to \c Backend::thread
+     */
+    Backend backend() const {
+        return _ring ? Backend::io_uring : Backend::thread;
+    }
+
+    static const char *backendName(Backend backend);
+
+    /**
+     * Check whether the kernel lets \c backend be used
+     */
+    static bool supported(Backend backend);
+
+    /**
+     * Read size for blocks filled from now on
+     */
+    void readSize(size_t readSize);
+
+    /**
+     * Give the current block back and take the next one
+     * \param [out] data block start
+     * \param [out] requested read size the block was filled with
+     * \return the same as \c read (2) including errno values
+     *
+     * Once end of file or failure is reached it is reported
+     * on every subsequent call.
+     */
+    ssize_t next(char **data, size_t *requested);
+};
+
+#endif /* READ_AHEAD_H */
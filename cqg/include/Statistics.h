@@ -0,0 +1,85 @@
+#ifndef STATISTICS_H
+# define STATISTICS_H
+
+#include "StatisticsChecker.h"
+#include "Output.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Per-file aggregate of \c StatisticsChecker line figures.
+ *
+ * Besides totals two histograms are kept with power of two
+ * buckets: bucket nil holds value nil, bucket \c k holds
+ * values from \c 2^(k-1) up to \c 2^k - 1.
+ *
+ * The aggregate is emitted either as CSV:
+ * \code
+ * metric,bucket,count
+ * lines,,10
+ * ...
+ * max_depth,4,3        <- lines with max depth from 4 up to 7
+ * failure_position,1,2 <- lines failed at the very first character
+ * \endcode
+ * with empty buckets omitted, or as a binary record in host
+ * byte order: \c BINARY_MAGIC, \c uint32_t version and bucket
+ * count followed by \c uint64_t totals in the order of \c Totals
+ * and both histograms of \c BUCKETS \c uint64_t each.
+ */
+class Statistics {
+public:
+    /*** types ***/
+    static const size_t BUCKETS = 65;
+    static const uint32_t BINARY_VERSION = 1;
+    static const char BINARY_MAGIC[8];
+
+    enum class Format {
+        csv,
+        binary,
+    };
+
+    struct Totals {
+        uint64_t    lines       = 0;
+        uint64_t    valid       = 0;
+        uint64_t    superfluous = 0;    /// lines failed with superfluous bracket
+        uint64_t    lack        = 0;    /// lines failed with lack of closing one
+        uint64_t    opening     = 0;
+        uint64_t    closing     = 0;
+        uint64_t    deepest     = 0;    /// the deepest nesting in the file
+    };
+
+private:
+    /*** data ***/
+    Totals          _totals;
+    uint64_t        _depth[BUCKETS];    ///< per-line max depth histogram
+    uint64_t        _position[BUCKETS]; ///< failure position histogram
+
+    static size_t _bucket(uint64_t value);
+
+    /**
+     * Smallest value of the bucket
+     */
+    static uint64_t _lowerBound(size_t bucket);
+
+public:
+    /*** API ***/
+    Statistics();
+
+    /**
+     * Account a line result
+     */
+    void add(bool isValid, const StatisticsChecker::Context &ctx);
+
+    const Totals &totals() const {
+        return _totals;
+    }
+
+    /**
+     * Write the aggregate out
+     * \return \c false on write failure, see \c output.error()
+     */
+    bool write(Output &output, Format format) const;
+};
+
+#endif /* STATISTICS_H */
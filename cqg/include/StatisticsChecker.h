@@ -0,0 +1,91 @@
+#ifndef STATISTICS_CHECKER_H
+# define STATISTICS_CHECKER_H
+
+#include "BracketScanner.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Parenthesis checker for a single pair of brackets
+ * gathering per-line figures along with validation.
+ *
+ * The usage is the same as for \c ParenthesisChecker.
+ * Figures are collected in the very same vectorized pass
+ * of \c BracketScanner, there is no second scan. For a failed
+ * line they cover the line up to the failing character
+ * since the rest of it is never scanned.
+ */
+class StatisticsChecker {
+public:
+    /*** types ***/
+    struct Context {
+        ssize_t     openIndex   = 0;    /// the same as for \c ParenthesisChecker
+        size_t      position    = 0;    /// the same as for \c ParenthesisChecker
+        ssize_t     maxDepth    = 0;    /// maximum nesting depth reached
+        size_t      opening     = 0;    /// opening brackets met
+        size_t      closing     = 0;    /// closing brackets met
+    };
+
+private:
+    /*** data ***/
+    char            _opening;
+    char            _closing;
+    BracketScanner  _scanner;
+    Context         _context;
+
+public:
+    /*** API ***/
+    /**
+     * c-tor
+     * Defaults opening bracket to '('
+     * and the closing one to ')'
+     */
+    StatisticsChecker();
+
+    /**
+     * Reset the checker
+     * The same rules as for \c ParenthesisChecker::reset apply
+     */
+    bool reset(char opening = '(',
+               char closing = ')');
+
+    /**
+     * Reset the state for another line keeping the brackets
+     */
+    void restart() {
+        _context = Context();
+    }
+
+    /**
+     * Validate the block
+     * \param str block start
+     * \param length block length
+     * \return \c true if block is still valid
+     */
+    bool validate(const char *str, size_t length);
+
+    /**
+     * Notify the checker that the line is finished.
+     * \return \c true if there are no open brackets left
+     */
+    bool done();
+
+    const Context& getContext() const {
+        return _context;
+    }
+
+    /**
+     * Select scanning kernel.
+     * \return \c false if the kernel isn't supported by CPU
+     */
+    bool kernel(BracketScanner::Kernel k) {
+        return _scanner.kernel(k);
+    }
+
+    BracketScanner::Kernel kernel() const {
+        return _scanner.kernel();
+    }
+};
+
+#endif /* STATISTICS_CHECKER_H */
@@ -0,0 +1,146 @@
+#ifndef STREAM_VALIDATOR_H
+# define STREAM_VALIDATOR_H
+
+#include "Input.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <functional>
+
+/**
+ * Streaming validation engine.
+ *
+ * Owns the read/validate/skip loop driving a checker over
+ * every line of a file descriptor or a memory range and reports
+ * each line result with a callback in line order.
+ *
+ * \tparam Checker \c ParenthesisChecker, \c MultiParenthesisChecker
+ *                 or \c StatisticsChecker
+ *
+ * Typical usage:
+ * \code
+ * StreamValidator<MultiParenthesisChecker> validator;
+ * validator.checker().reset("()[]");
+ * if (!validator.run(fd, [](size_t line, bool isValid,
+ *                           const MultiParenthesisChecker::Context &ctx) {
+ *         ...
+ *     })) {
+ *     report read failure at validator.line()
+ * }
+ * \endcode
+ *
+ * Each newline-terminated line is reported once. The last line
+ * lacking a delimiter is reported only if it has already failed
+ * before the end of input, just like check-parenthesis does.
+ *
+ * The engine is free to pick the way it gets the data through:
+ * regular files are mapped into memory by default and memory ranges
+ * are validated a whole line at a time.
+ */
+template <class Checker>
+class StreamValidator {
+public:
+    /*** types ***/
+    typedef typename Checker::Context Context;
+
+    /**
+     * Line result callback
+     * \param line line number, starting with 1
+     * \param isValid whether the line is valid
+     * \param ctx checker context at the point of failure or at the line end
+     */
+    typedef std::function<void(size_t line,
+                               bool isValid,
+                               const Context &ctx)> LineCallback;
+
+private:
+    /*** data ***/
+    Checker         _checker;
+    char            _delim;
+    Input::Mode     _mode;
+    size_t          _readSizeCeiling;
+    size_t          _readAheadBuffers;
+    ReadAhead::Backend _readAheadBackend;
+    size_t          _line;
+    Input::Stats    _stats;
+
+public:
+    /*** API ***/
+    /**
+     * c-tor
+     * \param delim line delimiter
+     */
+    StreamValidator(char delim = '\n');
+
+    /**
+     * Checker to configure brackets with
+     */
+    Checker &checker() {
+        return _checker;
+    }
+
+    /**
+     * Input mode for \c run with file descriptor,
+     * defaults to \c Input::Mode::mmap
+     */
+    void inputMode(Input::Mode mode) {
+        _mode = mode;
+    }
+
+    /**
+     * Read size ceiling for \c Input::Mode::read,
+     * see \c Input::readSizeCeiling
+     */
+    void readSizeCeiling(size_t ceiling) {
+        _readSizeCeiling = ceiling;
+    }
+
+    /**
+     * Number of buffers for \c Input::Mode::read_ahead
+     */
+    void readAheadBuffers(size_t buffers) {
+        _readAheadBuffers = buffers;
+    }
+
+    /**
+     * Preferred backend for \c Input::Mode::read_ahead,
+     * defaults to \c ReadAhead::Backend::io_uring
+     */
+    void readAheadBackend(ReadAhead::Backend backend) {
+        _readAheadBackend = backend;
+    }
+
+    /**
+     * Validate every line from \c fd till EOF
+     * \param index line index of the file to seek with
+     * \param firstLine line to start at, reported line numbers
+     *                  remain absolute; requires \c index
+     * \return \c false on read or seek failure, see \c errno for error code
+     */
+    bool run(int fd, const LineCallback &callback,
+             const LineIndex *index = NULL, size_t firstLine = 1);
+
+    /**
+     * Validate every line in memory range
+     * \return \c true
+     */
+    bool run(const char *data, size_t length, const LineCallback &callback);
+
+    /**
+     * Number of the line being processed i.e. the one
+     * read failure has happened at
+     */
+    size_t line() const {
+        return _line;
+    }
+
+    /**
+     * Input statistics of the last \c run with file descriptor
+     */
+    const Input::Stats &stats() const {
+        return _stats;
+    }
+};
+
+#endif /* STREAM_VALIDATOR_H */
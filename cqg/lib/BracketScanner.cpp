@@ -0,0 +1,521 @@
+#include "BracketScanner.h"
+
+#include <stdint.h>
+
+#if defined(__x86_64__)
+# include <immintrin.h>
+# define HAVE_X86_KERNELS 1
+#endif
+
+/*** scalar kernel ***/
+static size_t _scanScalar(const char *str, size_t length,
+                          char opening, char closing,
+                          ssize_t *depth) {
+    ssize_t d = *depth;
+
+    for (size_t idx = 0; idx < length; ++idx) {
+        if (str[idx] == opening) {
+            ++d;
+        }
+        else if (str[idx] == closing) {
+            if (!d) {
+                *depth = d;
+                return idx;
+            }
+
+            --d;
+        }
+    }
+
+    *depth = d;
+    return length;
+}
+
+static size_t _tallyScalar(const char *str, size_t length,
+                           char opening, char closing,
+                           ssize_t *depth, BracketScanner::Tally *tally) {
+    ssize_t d = *depth;
+
+    for (size_t idx = 0; idx < length; ++idx) {
+        if (str[idx] == opening) {
+            ++tally->opening;
+
+            if (++d > tally->maxDepth) {
+                tally->maxDepth = d;
+            }
+        }
+        else if (str[idx] == closing) {
+            ++tally->closing;
+
+            if (!d) {
+                *depth = d;
+                return idx;
+            }
+
+            --d;
+        }
+    }
+
+    *depth = d;
+    return length;
+}
+
+#ifdef HAVE_X86_KERNELS
+/*** SSE2 kernel ***/
+/**
+ * Resolve a 16-byte block with at least a single closing bracket in it
+ * while \c *depth is less than block size.
+ * \return index of the failing character or 16
+ */
+static inline size_t _resolveSse2(__m128i block,
+                                  __m128i vOpen, __m128i vClose,
+                                  ssize_t *depth) {
+    /* +1 for opening, -1 for closing, 0 otherwise */
+    __m128i prefix = _mm_sub_epi8(_mm_cmpeq_epi8(block, vClose),
+                                  _mm_cmpeq_epi8(block, vOpen));
+
+    prefix = _mm_add_epi8(prefix, _mm_slli_si128(prefix, 1));
+    prefix = _mm_add_epi8(prefix, _mm_slli_si128(prefix, 2));
+    prefix = _mm_add_epi8(prefix, _mm_slli_si128(prefix, 4));
+    prefix = _mm_add_epi8(prefix, _mm_slli_si128(prefix, 8));
+
+    /* depth + prefix[i] < 0 <=> prefix[i] < -depth */
+    __m128i threshold = _mm_set1_epi8(static_cast<char>(-*depth));
+    unsigned failMask = _mm_movemask_epi8(_mm_cmpgt_epi8(threshold, prefix));
+
+    if (failMask) {
+        *depth = 0;
+        return __builtin_ctz(failMask);
+    }
+
+    *depth += static_cast<int8_t>(_mm_extract_epi16(prefix, 7) >> 8);
+    return 16;
+}
+
+/**
+ * Maximum of signed bytes biased by 0x80 i.e. ordered as unsigned ones
+ */
+static inline int _maxBiasedSse2(__m128i biased) {
+    biased = _mm_max_epu8(biased, _mm_srli_si128(biased, 8));
+    biased = _mm_max_epu8(biased, _mm_srli_si128(biased, 4));
+    biased = _mm_max_epu8(biased, _mm_srli_si128(biased, 2));
+    biased = _mm_max_epu8(biased, _mm_srli_si128(biased, 1));
+
+    return (_mm_cvtsi128_si32(biased) & 0xff) - 0x80;
+}
+
+/**
+ * Resolve a 16-byte block the way \c _resolveSse2 does
+ * additionally raising \c *maxDepth with the depth reached
+ * before the failing character. Any \c *depth is allowed.
+ */
+static inline size_t _resolveTallySse2(__m128i block,
+                                       __m128i vOpen, __m128i vClose,
+                                       ssize_t *depth, ssize_t *maxDepth) {
+    __m128i prefix = _mm_sub_epi8(_mm_cmpeq_epi8(block, vClose),
+                                  _mm_cmpeq_epi8(block, vOpen));
+
+    prefix = _mm_add_epi8(prefix, _mm_slli_si128(prefix, 1));
+    prefix = _mm_add_epi8(prefix, _mm_slli_si128(prefix, 2));
+    prefix = _mm_add_epi8(prefix, _mm_slli_si128(prefix, 4));
+    prefix = _mm_add_epi8(prefix, _mm_slli_si128(prefix, 8));
+
+    unsigned failMask = 0;
+
+    if (*depth < 16) {
+        __m128i threshold = _mm_set1_epi8(static_cast<char>(-*depth));
+        failMask = _mm_movemask_epi8(_mm_cmpgt_epi8(threshold, prefix));
+    }
+
+    size_t fail = failMask ? __builtin_ctz(failMask) : 16;
+
+    /* lanes past the failure are biased down to the very minimum */
+    __m128i lanes = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                  8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i valid = _mm_cmpgt_epi8(_mm_set1_epi8(static_cast<char>(fail)), lanes);
+    __m128i biased = _mm_and_si128(_mm_xor_si128(prefix, _mm_set1_epi8(-0x80)), valid);
+    ssize_t blockMax = *depth + _maxBiasedSse2(biased);
+
+    if (blockMax > *maxDepth) {
+        *maxDepth = blockMax;
+    }
+
+    if (failMask) {
+        *depth = 0;
+        return fail;
+    }
+
+    *depth += static_cast<int8_t>(_mm_extract_epi16(prefix, 7) >> 8);
+    return 16;
+}
+
+static size_t _scanSse2(const char *str, size_t length,
+                        char opening, char closing,
+                        ssize_t *depth) {
+    const __m128i vOpen = _mm_set1_epi8(opening);
+    const __m128i vClose = _mm_set1_epi8(closing);
+    ssize_t d = *depth;
+    size_t idx = 0;
+
+    for (; idx + 16 <= length; idx += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(str + idx));
+        unsigned openMask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, vOpen));
+        unsigned closeMask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, vClose));
+
+        if (!closeMask || d >= 16) {
+            /* can't fail within this block */
+            d += __builtin_popcount(openMask) - __builtin_popcount(closeMask);
+            continue;
+        }
+
+        size_t fail = _resolveSse2(block, vOpen, vClose, &d);
+        if (fail < 16) {
+            *depth = d;
+            return idx + fail;
+        }
+    }
+
+    size_t fail = _scanScalar(str + idx, length - idx, opening, closing, &d);
+    *depth = d;
+
+    return idx + fail;
+}
+
+static size_t _tallySse2(const char *str, size_t length,
+                         char opening, char closing,
+                         ssize_t *depth, BracketScanner::Tally *tally) {
+    const __m128i vOpen = _mm_set1_epi8(opening);
+    const __m128i vClose = _mm_set1_epi8(closing);
+    ssize_t d = *depth;
+    size_t idx = 0;
+
+    for (; idx + 16 <= length; idx += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(str + idx));
+        unsigned openMask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, vOpen));
+        unsigned closeMask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, vClose));
+        ssize_t opens = __builtin_popcount(openMask);
+
+        /* neither failure nor a new maximum is possible */
+        if (!closeMask || (d >= 16 && d + opens <= tally->maxDepth)) {
+            d += opens - __builtin_popcount(closeMask);
+
+            if (d > tally->maxDepth) {
+                tally->maxDepth = d;
+            }
+
+            tally->opening += opens;
+            tally->closing += __builtin_popcount(closeMask);
+            continue;
+        }
+
+        size_t fail = _resolveTallySse2(block, vOpen, vClose, &d, &tally->maxDepth);
+
+        if (fail < 16) {
+            unsigned scanned = (2u << fail) - 1;
+
+            tally->opening += __builtin_popcount(openMask & scanned);
+            tally->closing += __builtin_popcount(closeMask & scanned);
+            *depth = d;
+            return idx + fail;
+        }
+
+        tally->opening += opens;
+        tally->closing += __builtin_popcount(closeMask);
+    }
+
+    size_t fail = _tallyScalar(str + idx, length - idx, opening, closing, &d, tally);
+    *depth = d;
+
+    return idx + fail;
+}
+
+/*** AVX2 kernel ***/
+/**
+ * Resolve a 32-byte block with at least a single closing bracket in it
+ * while \c *depth is less than block size.
+ * \return index of the failing character or 32
+ */
+__attribute__((target("avx2")))
+static inline size_t _resolveAvx2(__m256i block,
+                                  __m256i vOpen, __m256i vClose,
+                                  ssize_t *depth) {
+    /* +1 for opening, -1 for closing, 0 otherwise */
+    __m256i prefix = _mm256_sub_epi8(_mm256_cmpeq_epi8(block, vClose),
+                                     _mm256_cmpeq_epi8(block, vOpen));
+
+    /* prefix sums within 128-bit lanes */
+    prefix = _mm256_add_epi8(prefix, _mm256_slli_si256(prefix, 1));
+    prefix = _mm256_add_epi8(prefix, _mm256_slli_si256(prefix, 2));
+    prefix = _mm256_add_epi8(prefix, _mm256_slli_si256(prefix, 4));
+    prefix = _mm256_add_epi8(prefix, _mm256_slli_si256(prefix, 8));
+
+    /* carry the low lane total into the high lane */
+    __m256i carry = _mm256_permute2x128_si256(prefix, prefix, 0x08);
+    carry = _mm256_shuffle_epi8(carry, _mm256_set1_epi8(15));
+    prefix = _mm256_add_epi8(prefix, carry);
+
+    /* depth + prefix[i] < 0 <=> prefix[i] < -depth */
+    __m256i threshold = _mm256_set1_epi8(static_cast<char>(-*depth));
+    uint32_t failMask = _mm256_movemask_epi8(_mm256_cmpgt_epi8(threshold, prefix));
+
+    if (failMask) {
+        *depth = 0;
+        return __builtin_ctz(failMask);
+    }
+
+    *depth += static_cast<int8_t>(_mm256_extract_epi8(prefix, 31));
+    return 32;
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t _scanAvx2(const char *str, size_t length,
+                        char opening, char closing,
+                        ssize_t *depth) {
+    const __m256i vOpen = _mm256_set1_epi8(opening);
+    const __m256i vClose = _mm256_set1_epi8(closing);
+    ssize_t d = *depth;
+    size_t idx = 0;
+
+    for (; idx + 64 <= length; idx += 64) {
+        __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(str + idx));
+        __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(str + idx + 32));
+
+        uint64_t openMask =
+            static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, vOpen))) |
+            (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, vOpen)))) << 32);
+        uint64_t closeMask =
+            static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, vClose))) |
+            (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, vClose)))) << 32);
+
+        if (!closeMask || d >= 64) {
+            /* can't fail within this block */
+            d += __builtin_popcountll(openMask) - __builtin_popcountll(closeMask);
+            continue;
+        }
+
+        size_t fail = _resolveAvx2(lo, vOpen, vClose, &d);
+        if (fail < 32) {
+            *depth = d;
+            return idx + fail;
+        }
+
+        fail = _resolveAvx2(hi, vOpen, vClose, &d);
+        if (fail < 32) {
+            *depth = d;
+            return idx + 32 + fail;
+        }
+    }
+
+    size_t fail = _scanSse2(str + idx, length - idx, opening, closing, &d);
+    *depth = d;
+
+    return idx + fail;
+}
+/**
+ * Resolve a 32-byte block the way \c _resolveAvx2 does
+ * additionally raising \c *maxDepth with the depth reached
+ * before the failing character. Any \c *depth is allowed.
+ */
+__attribute__((target("avx2")))
+static inline size_t _resolveTallyAvx2(__m256i block,
+                                       __m256i vOpen, __m256i vClose,
+                                       ssize_t *depth, ssize_t *maxDepth) {
+    __m256i prefix = _mm256_sub_epi8(_mm256_cmpeq_epi8(block, vClose),
+                                     _mm256_cmpeq_epi8(block, vOpen));
+
+    prefix = _mm256_add_epi8(prefix, _mm256_slli_si256(prefix, 1));
+    prefix = _mm256_add_epi8(prefix, _mm256_slli_si256(prefix, 2));
+    prefix = _mm256_add_epi8(prefix, _mm256_slli_si256(prefix, 4));
+    prefix = _mm256_add_epi8(prefix, _mm256_slli_si256(prefix, 8));
+
+    __m256i carry = _mm256_permute2x128_si256(prefix, prefix, 0x08);
+    carry = _mm256_shuffle_epi8(carry, _mm256_set1_epi8(15));
+    prefix = _mm256_add_epi8(prefix, carry);
+
+    uint32_t failMask = 0;
+
+    if (*depth < 32) {
+        __m256i threshold = _mm256_set1_epi8(static_cast<char>(-*depth));
+        failMask = _mm256_movemask_epi8(_mm256_cmpgt_epi8(threshold, prefix));
+    }
+
+    size_t fail = failMask ? __builtin_ctz(failMask) : 32;
+
+    /* lanes past the failure are biased down to the very minimum */
+    __m256i lanes = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                     8, 9, 10, 11, 12, 13, 14, 15,
+                                     16, 17, 18, 19, 20, 21, 22, 23,
+                                     24, 25, 26, 27, 28, 29, 30, 31);
+    __m256i valid = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(fail)), lanes);
+    __m256i biased = _mm256_and_si256(_mm256_xor_si256(prefix, _mm256_set1_epi8(-0x80)),
+                                      valid);
+
+    biased = _mm256_max_epu8(biased, _mm256_permute2x128_si256(biased, biased, 0x01));
+
+    ssize_t blockMax = *depth + _maxBiasedSse2(_mm256_castsi256_si128(biased));
+
+    if (blockMax > *maxDepth) {
+        *maxDepth = blockMax;
+    }
+
+    if (failMask) {
+        *depth = 0;
+        return fail;
+    }
+
+    *depth += static_cast<int8_t>(_mm256_extract_epi8(prefix, 31));
+    return 32;
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t _tallyAvx2(const char *str, size_t length,
+                         char opening, char closing,
+                         ssize_t *depth, BracketScanner::Tally *tally) {
+    const __m256i vOpen = _mm256_set1_epi8(opening);
+    const __m256i vClose = _mm256_set1_epi8(closing);
+    ssize_t d = *depth;
+    size_t idx = 0;
+
+    for (; idx + 64 <= length; idx += 64) {
+        __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(str + idx));
+        __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(str + idx + 32));
+
+        uint64_t openMask =
+            static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, vOpen))) |
+            (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, vOpen)))) << 32);
+        uint64_t closeMask =
+            static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, vClose))) |
+            (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, vClose)))) << 32);
+        ssize_t opens = __builtin_popcountll(openMask);
+
+        /* neither failure nor a new maximum is possible */
+        if (!closeMask || (d >= 64 && d + opens <= tally->maxDepth)) {
+            d += opens - __builtin_popcountll(closeMask);
+
+            if (d > tally->maxDepth) {
+                tally->maxDepth = d;
+            }
+
+            tally->opening += opens;
+            tally->closing += __builtin_popcountll(closeMask);
+            continue;
+        }
+
+        size_t fail = _resolveTallyAvx2(lo, vOpen, vClose, &d, &tally->maxDepth);
+
+        if (fail == 32) {
+            fail = 32 + _resolveTallyAvx2(hi, vOpen, vClose, &d, &tally->maxDepth);
+        }
+
+        if (fail < 64) {
+            uint64_t scanned = fail < 63 ? (static_cast<uint64_t>(2) << fail) - 1 : ~0ull;
+
+            tally->opening += __builtin_popcountll(openMask & scanned);
+            tally->closing += __builtin_popcountll(closeMask & scanned);
+            *depth = d;
+            return idx + fail;
+        }
+
+        tally->opening += opens;
+        tally->closing += __builtin_popcountll(closeMask);
+    }
+
+    size_t fail = _tallySse2(str + idx, length - idx, opening, closing, &d, tally);
+    *depth = d;
+
+    return idx + fail;
+}
+#endif /* HAVE_X86_KERNELS */
+
+/*** BracketScanner ***/
+BracketScanner::BracketScanner(char opening, char closing, Kernel kernel)
+: _opening(opening),
+  _closing(closing),
+  _kernel(Kernel::scalar),
+  _function(&_scanScalar),
+  _tallyFunction(&_tallyScalar)
+{
+    if (!this->kernel(kernel)) {
+        this->kernel(Kernel::best);
+    }
+}
+
+bool BracketScanner::kernel(Kernel k) {
+    if (Kernel::best == k) {
+        k = bestKernel();
+    }
+
+    if (!supported(k)) {
+        return false;
+    }
+
+    switch (k) {
+#ifdef HAVE_X86_KERNELS
+        case Kernel::avx2:
+            _function = &_scanAvx2;
+            _tallyFunction = &_tallyAvx2;
+            break;
+
+        case Kernel::sse2:
+            _function = &_scanSse2;
+            _tallyFunction = &_tallySse2;
+            break;
+#endif
+
+        default:
+            _function = &_scanScalar;
+            _tallyFunction = &_tallyScalar;
+            break;
+    }
+
+    _kernel = k;
+
+    return true;
+}
+
+bool BracketScanner::supported(Kernel k) {
+    switch (k) {
+        case Kernel::scalar:
+        case Kernel::best:
+            return true;
+
+#ifdef HAVE_X86_KERNELS
+        case Kernel::sse2:
+            return true;
+
+        case Kernel::avx2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") &&
+                   __builtin_cpu_supports("popcnt");
+#endif
+
+        default:
+            return false;
+    }
+}
+
+BracketScanner::Kernel BracketScanner::bestKernel() {
+    static const Kernel CANDIDATES[] = {
+        Kernel::avx2,
+        Kernel::sse2,
+    };
+
+    for (Kernel k : CANDIDATES) {
+        if (supported(k)) {
+            return k;
+        }
+    }
+
+    return Kernel::scalar;
+}
+
+const char *BracketScanner::kernelName(Kernel k) {
+    switch (k) {
+        case Kernel::scalar:    return "scalar";
+        case Kernel::sse2:      return "sse2";
+        case Kernel::avx2:      return "avx2";
+        case Kernel::best:      return kernelName(bestKernel());
+    }
+
+    return "unknown";
+}
@@ -0,0 +1,27 @@
+#include "BracketStack.h"
+
+#include <stdlib.h>
+
+BracketStack::BracketStack()
+: _size(0)
+{
+    /* empty */
+}
+
+BracketStack::~BracketStack() {
+    for (uint8_t *chunk : _chunks) {
+        free(chunk);
+    }
+}
+
+bool BracketStack::_grow() {
+    uint8_t *chunk = reinterpret_cast<uint8_t *>(malloc(CHUNK_SIZE));
+
+    if (!chunk) {
+        return false;
+    }
+
+    _chunks.push_back(chunk);
+
+    return true;
+}
@@ -1,33 +1,103 @@
 #include "Buffer.h"
+#include "BufferPool.h"
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 
 #include <stdexcept>
 #include <exception>
 
-Buffer::Buffer(size_t initialSize)
+const Buffer::GrowthFunction Buffer::GROWTH[static_cast<size_t>(Growth::_count)] = {
+    &Buffer::_growExact,
+    &Buffer::_growGeometric,
+    &Buffer::_growPageAligned
+};
+
+size_t Buffer::_growExact(size_t /*size*/, size_t newSize) {
+    return newSize;
+}
+
+size_t Buffer::_growGeometric(size_t size, size_t newSize) {
+    return newSize < 2 * size ? 2 * size : newSize;
+}
+
+size_t Buffer::_growPageAligned(size_t size, size_t newSize) {
+    size_t alignment = sysconf(_SC_PAGESIZE);
+
+    newSize = _growGeometric(size, newSize);
+
+    if (newSize >= HUGE_PAGE_SIZE) {
+        alignment = HUGE_PAGE_SIZE;
+    }
+
+    return (newSize + alignment - 1) / alignment * alignment;
+}
+
+Buffer::Buffer(size_t initialSize, Growth growth, bool pooled)
 : _size(initialSize),
   _userSize(initialSize),
   _data(NULL),
   _offset(0),
-  _invalid(false)
+  _invalid(false),
+  _growth(growth),
+  _pooled(pooled)
 {
     if (initialSize) {
-        _data = malloc(initialSize);
+        if (Growth::page_aligned == _growth) {
+            _size = _growPageAligned(0, initialSize);
+        }
+
+        _data = _allocate(&_size);
         if (!_data) {
+            _size = _userSize = 0;
             _invalid = true;
         }
     }
 }
 
+void *Buffer::_allocate(size_t *size) const {
+    bool aligned = Growth::page_aligned == _growth;
+    void *data = NULL;
+
+    if (_pooled) {
+        data = BufferPool::acquire(*size, aligned, size);
+        if (data) {
+            return data;
+        }
+    }
+
+    if (!aligned) {
+        return malloc(*size);
+    }
+
+    size_t alignment = *size >= HUGE_PAGE_SIZE ?
+                           HUGE_PAGE_SIZE :
+                           sysconf(_SC_PAGESIZE);
+
+    if (posix_memalign(&data, alignment, *size)) {
+        return NULL;
+    }
+
+    if (*size >= HUGE_PAGE_SIZE) {
+        /* just a hint, failure is not fatal */
+        madvise(data, *size, MADV_HUGEPAGE);
+    }
+
+    return data;
+}
+
 Buffer::Buffer(size_t userSize, size_t realSize, void *data)
 : _size(realSize),
   _userSize(userSize),
   _data(data),
   _offset(0),
-  _invalid(false)
+  _invalid(false),
+  _growth(Growth::exact),
+  _pooled(false)
 {
     if (_size < _userSize || (_size && !_data)) {
         _invalid = true;
@@ -39,7 +109,9 @@ Buffer::Buffer(size_t userSize, size_t realSize, void *data, off_t offset)
   _userSize(userSize),
   _data(data),
   _offset(offset),
-  _invalid(false)
+  _invalid(false),
+  _growth(Growth::exact),
+  _pooled(false)
 {
     if (_size < _userSize || (_size && !_data)) {
         _invalid = true;
@@ -54,6 +126,9 @@ Buffer& Buffer::operator=(Buffer&& rhs) {
         _userSize = rhs._userSize;
         _data = rhs._data;
         _offset = rhs._offset;
+        _invalid = rhs._invalid;
+        _growth = rhs._growth;
+        _pooled = rhs._pooled;
 
         rhs._size = rhs._userSize = 0;
         rhs._data = NULL;
@@ -67,7 +142,10 @@ Buffer::Buffer(Buffer &&that)
 : _size(that._size),
   _userSize(that._userSize),
   _data(that._data),
-  _offset(that._offset)
+  _offset(that._offset),
+  _invalid(that._invalid),
+  _growth(that._growth),
+  _pooled(that._pooled)
 {
     that._size = that._userSize = 0;
     that._data = NULL;
@@ -79,7 +157,14 @@ Buffer::~Buffer() {
 }
 
 void Buffer::_deallocate() {
-    if (_data) {
+    if (!_data) {
+        return;
+    }
+
+    if (_pooled) {
+        BufferPool::recycle(_data, _size, Growth::page_aligned == _growth);
+    }
+    else {
         free(_data);
     }
 }
@@ -101,13 +186,31 @@ bool Buffer::resize(size_t newSize) {
         return true;
     }
 
-    void *newBuf = realloc(_data, newSize);
+    size_t realSize = GROWTH[static_cast<size_t>(_growth)](_size, newSize);
+    void *newBuf;
+
+    if (Growth::page_aligned == _growth || _pooled) {
+        /* realloc keeps neither alignment nor pool in mind */
+        newBuf = _allocate(&realSize);
+        if (newBuf && _data) {
+            memcpy(newBuf, _data, _size);
+        }
+
+        if (newBuf) {
+            _deallocate();
+        }
+    }
+    else {
+        newBuf = realloc(_data, realSize);
+    }
+
     if (!newBuf) {
         _invalid = true;
         return false;
     }
 
-    _size = _userSize = newSize;
+    _size = realSize;
+    _userSize = newSize;
     _data = newBuf;
 
     return true;
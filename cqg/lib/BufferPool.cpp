@@ -0,0 +1,115 @@
+#include "BufferPool.h"
+
+#include <stdlib.h>
+
+namespace {
+
+struct Entry {
+    void    *data;
+    size_t  size;
+    bool    aligned;
+};
+
+struct FreeList {
+    Entry               entries[BufferPool::MAX_ENTRIES];
+    BufferPool::Stats   stats;
+
+    ~FreeList();
+};
+
+thread_local FreeList freeList;
+/* constant initialized and trivially destructible, so it stays
+ * readable while the thread destroys its other thread_local objects */
+thread_local bool freeListDestroyed = false;
+
+FreeList::~FreeList() {
+    BufferPool::purge();
+    freeListDestroyed = true;
+}
+
+}   /* namespace */
+
+void *BufferPool::acquire(size_t size, bool aligned, size_t *realSize) {
+    if (freeListDestroyed) {
+        return NULL;
+    }
+
+    Stats &stats = freeList.stats;
+    size_t bestIdx = stats.entries;
+
+    for (size_t idx = 0; idx < stats.entries; ++idx) {
+        const Entry &entry = freeList.entries[idx];
+
+        if (entry.size < size || (aligned && !entry.aligned)) {
+            continue;
+        }
+
+        if (bestIdx == stats.entries || entry.size < freeList.entries[bestIdx].size) {
+            bestIdx = idx;
+        }
+    }
+
+    if (bestIdx == stats.entries) {
+        ++stats.misses;
+        return NULL;
+    }
+
+    Entry entry = freeList.entries[bestIdx];
+
+    freeList.entries[bestIdx] = freeList.entries[--stats.entries];
+    stats.bytes -= entry.size;
+    ++stats.hits;
+
+    *realSize = entry.size;
+
+    return entry.data;
+}
+
+bool BufferPool::recycle(void *data, size_t realSize, bool aligned) {
+    if (!data) {
+        return true;
+    }
+
+    /* a pooled buffer destroyed at thread exit after the list */
+    if (freeListDestroyed) {
+        free(data);
+        return false;
+    }
+
+    Stats &stats = freeList.stats;
+
+    if (stats.entries >= MAX_ENTRIES || stats.bytes + realSize > MAX_BYTES) {
+        ++stats.dropped;
+        free(data);
+        return false;
+    }
+
+    freeList.entries[stats.entries++] = Entry{data, realSize, aligned};
+    stats.bytes += realSize;
+    ++stats.recycled;
+
+    return true;
+}
+
+void BufferPool::purge() {
+    if (freeListDestroyed) {
+        return;
+    }
+
+    Stats &stats = freeList.stats;
+
+    for (size_t idx = 0; idx < stats.entries; ++idx) {
+        free(freeList.entries[idx].data);
+    }
+
+    stats.entries = 0;
+    stats.bytes = 0;
+}
+
+BufferPool::Stats BufferPool::stats() {
+    if (freeListDestroyed) {
+        return Stats();
+    }
+
+    return freeList.stats;
+}
@@ -3,50 +3,254 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <linux/limits.h>
 
+#include <utility>
+
 Input::Input()
-: _fd(-1)
+: _fd(-1),
+  _prevNewline(NULL),
+  _maxBufferSize(0),
+  _readSizeCeiling(0),
+  _consecutiveFullReads(0),
+  _mode(Mode::read),
+  _blockStart(NULL),
+  _blockEnd(NULL),
+  _map(NULL),
+  _mapLength(0),
+  _maxMapSize(0),
+  _fileOffset(0),
+  _fileSize(0)
 {
 }
 
 Input::Input(int fd,
              char delim,
-             size_t maxBufferSize)
+             size_t maxBufferSize,
+             Mode mode,
+             size_t maxMapSize,
+             size_t readAheadBuffers,
+             ReadAhead::Backend readAheadBackend)
 : _fd(fd),
   _delim(delim),
-  _buffer(maxBufferSize),
-  _maxBufferSize(maxBufferSize)
+  _buffer(Mode::read == mode ? maxBufferSize : 1,
+          Buffer::Growth::page_aligned,
+          true),
+  _maxBufferSize(maxBufferSize),
+  _readSizeCeiling(maxBufferSize),
+  _consecutiveFullReads(0),
+  _mode(mode),
+  _map(NULL),
+  _mapLength(0),
+  _maxMapSize(maxMapSize),
+  _fileOffset(0),
+  _fileSize(0)
 {
+    if (Mode::mmap == _mode && !_setupMapping()) {
+        _mode = Mode::read;
+    }
+
+    if (Mode::read_ahead == _mode) {
+        _readAhead.reset(new ReadAhead(_fd, readAheadBuffers, _maxBufferSize,
+                                       readAheadBackend));
+        _stats.readAhead = ReadAhead::backendName(_readAhead->backend());
+    }
+
+    _stats.readSize = _maxBufferSize;
+
     *reinterpret_cast<char *>(_buffer.data()) = '\0';
     _buffer.resize(1);
-    _prevNewline = reinterpret_cast<char *>(_buffer.data()) + _buffer.size();
+    _blockStart = reinterpret_cast<char *>(_buffer.data());
+    _blockEnd = _blockStart + _buffer.size();
+    _prevNewline = _blockEnd;
 }
 
 Input::~Input() {
-    /* empty */
+    _unmap();
 }
 
-bool Input::readUntilNewline(char **line, ssize_t *len,
-                             bool alreadyNewLine) {
-    bool result;
+Input::Input(Input &&rhs)
+: _fd(rhs._fd),
+  _delim(rhs._delim),
+  _prevNewline(rhs._prevNewline),
+  _buffer(std::move(rhs._buffer)),
+  _maxBufferSize(rhs._maxBufferSize),
+  _readSizeCeiling(rhs._readSizeCeiling),
+  _consecutiveFullReads(rhs._consecutiveFullReads),
+  _mode(rhs._mode),
+  _stats(rhs._stats),
+  _blockStart(rhs._blockStart),
+  _blockEnd(rhs._blockEnd),
+  _map(rhs._map),
+  _mapLength(rhs._mapLength),
+  _maxMapSize(rhs._maxMapSize),
+  _fileOffset(rhs._fileOffset),
+  _fileSize(rhs._fileSize),
+  _readAhead(std::move(rhs._readAhead))
+{
+    rhs._fd = -1;
+    rhs._map = NULL;
+    rhs._mapLength = 0;
+}
+
+Input &Input::operator=(Input &&rhs) {
+    if (this != &rhs) {
+        _unmap();
+
+        _fd = rhs._fd;
+        _delim = rhs._delim;
+        _prevNewline = rhs._prevNewline;
+        _buffer = std::move(rhs._buffer);
+        _maxBufferSize = rhs._maxBufferSize;
+        _readSizeCeiling = rhs._readSizeCeiling;
+        _consecutiveFullReads = rhs._consecutiveFullReads;
+        _mode = rhs._mode;
+        _stats = rhs._stats;
+        _blockStart = rhs._blockStart;
+        _blockEnd = rhs._blockEnd;
+        _map = rhs._map;
+        _mapLength = rhs._mapLength;
+        _maxMapSize = rhs._maxMapSize;
+        _fileOffset = rhs._fileOffset;
+        _fileSize = rhs._fileSize;
+        _readAhead = std::move(rhs._readAhead);
+
+        rhs._fd = -1;
+        rhs._map = NULL;
+        rhs._mapLength = 0;
+    }
+
+    return *this;
+}
+
+bool Input::readSizeCeiling(size_t ceiling) {
+    if (ceiling < _maxBufferSize) {
+        ceiling = _maxBufferSize;
+    }
+
+    _readSizeCeiling = ceiling;
+
+    struct stat st;
+
+    if (_fd < 0 || fstat(_fd, &st) < 0 || !S_ISFIFO(st.st_mode)) {
+        return true;
+    }
+
+    int capacity = fcntl(_fd, F_GETPIPE_SZ);
+    if (capacity < 0) {
+        return false;
+    }
+
+    _stats.pipeCapacity = capacity;
+
+    if (static_cast<size_t>(capacity) >= ceiling) {
+        return true;
+    }
+
+    /* the kernel rounds capacity up to a power of two pages */
+    capacity = fcntl(_fd, F_SETPIPE_SZ, static_cast<int>(ceiling));
+    if (capacity < 0) {
+        return false;
+    }
+
+    _stats.pipeCapacity = capacity;
+
+    return true;
+}
+
+bool Input::seek(off_t offset) {
+    if (_fd < 0) {
+        errno = EBADF;
+        return false;
+    }
+
+    if (Mode::mmap == _mode) {
+        if (offset < 0) {
+            errno = EINVAL;
+            return false;
+        }
 
-    if (!alreadyNewLine) {
-        do {
-            result = readAndDetectNewline(line, len);
-        } while (!result && *line);
+        _unmap();
+        _fileOffset = offset;
+        _resetBlock();
+
+        return true;
     }
 
-    if (!(*line))
-    {
+    size_t buffers = _readAhead ? _readAhead->buffers() : 0;
+    ReadAhead::Backend backend = _readAhead ? _readAhead->backend() :
+                                              ReadAhead::Backend::thread;
+
+    /* the reads in flight must not race with lseek */
+    _readAhead.reset();
+
+    bool result = lseek(_fd, offset, SEEK_SET) >= 0;
+
+    if (buffers) {
+        _readAhead.reset(new ReadAhead(_fd, buffers, _stats.readSize, backend));
+    }
+
+    _consecutiveFullReads = 0;
+    _resetBlock();
+
+    return result;
+}
+
+bool Input::seekLine(const LineIndex &index, size_t line) {
+    off_t offset = index.offset(line);
+
+    if (offset < 0) {
+        errno = ERANGE;
+        return false;
+    }
+
+    return seek(offset);
+}
+
+bool Input::readUntilNewline(char **line, ssize_t *len,
+                             bool alreadyNewLine) {
+    if (!alreadyNewLine && !skipLine()) {
         /* some failure obviously has hapened */
+        *line = NULL;
+        *len = errno ? -1 : 0;
         return false;
     }
 
     return readAndDetectNewline(line, len);
 }
 
+bool Input::skipLine() {
+    if (_fd < 0) {
+        errno = EBADF;
+        return false;
+    }
+
+    while (true) {
+        if (!_prevNewline || (_prevNewline >= _blockEnd)) {
+            /* the data is discarded anyway, read as much as allowed */
+            if (_readAnotherBlock(_readSizeCeiling) <= 0) {
+                return false;
+            }
+        }
+
+        char *nl = reinterpret_cast<char *>(memchr(_prevNewline, _delim,
+                                                   _blockEnd - _prevNewline));
+
+        if (nl) {
+            _stats.skippedBytes += nl - _prevNewline;
+            _prevNewline = nl + 1;
+            return true;
+        }
+
+        _stats.skippedBytes += _blockEnd - _prevNewline;
+        _prevNewline = _blockEnd;
+    }
+}
+
 void Input::start(char **line, ssize_t *len) {
     if (_fd < 0) {
         errno = EBADF;
@@ -55,7 +259,7 @@ void Input::start(char **line, ssize_t *len) {
         return;
     }
 
-    *line = reinterpret_cast<char *>(_buffer.data());
+    *line = _blockStart;
     *len = 0;
 }
 
@@ -67,12 +271,9 @@ bool Input::readAndDetectNewline(char **line, ssize_t *len) {
         return false;
     }
 
-    const char *bufferStart = reinterpret_cast<const char *>(_buffer.data());
-    const char *bufferEnd = bufferStart + _buffer.size();
-
     /* read another chunk if required */
-    if (!_prevNewline || (_prevNewline >= bufferEnd)) {
-        ssize_t bytesRead = _readAnotherBlock();
+    if (!_prevNewline || (_prevNewline >= _blockEnd)) {
+        ssize_t bytesRead = _readAnotherBlock(_stats.readSize);
 
         if (0 == bytesRead) {
             /* an eof obviously */
@@ -86,11 +287,11 @@ bool Input::readAndDetectNewline(char **line, ssize_t *len) {
             *len = -1;
             return false;
         }
-    }   /* if (_prevNewline >= bufferEnd) { */
+    }   /* if (_prevNewline >= _blockEnd) { */
 
     /* check if line break is in the chunk read */
     char *b = _prevNewline;
-    size_t sizeLeft = _buffer.size() - (b - reinterpret_cast<char *>(_buffer.data()));
+    size_t sizeLeft = _blockEnd - b;
     char *nl = reinterpret_cast<char *>(memchr(b, _delim, sizeLeft));
 
     *line = b;
@@ -100,21 +301,38 @@ bool Input::readAndDetectNewline(char **line, ssize_t *len) {
     if (_prevNewline) {
         /* skip the delimiting character */
         *len = _prevNewline - b;
-        *_prevNewline = '\0';
+
+        /* the mapping is read-only */
+        if (Mode::mmap != _mode) {
+            *_prevNewline = '\0';
+        }
+
         ++_prevNewline;
     }   /* if (_prevNewline) { */
     else {
         *len = sizeLeft;
 
         /* instigate another read operation upon subsequent call */
-        _prevNewline = reinterpret_cast<char *>(_buffer.data()) + _buffer.size();
+        _prevNewline = _blockEnd;
     }   /* if (_prevNewline) { - else */
 
     return !!nl;
 }
 
-ssize_t Input::_readAnotherBlock() {
-    if (!_buffer.resize(_maxBufferSize)) {
+ssize_t Input::_readAnotherBlock(size_t readSize) {
+    if (Mode::mmap == _mode) {
+        return _mapBlock();
+    }
+
+    if (Mode::read_ahead == _mode) {
+        return _readAheadBlock();
+    }
+
+    return _readBlock(readSize);
+}
+
+ssize_t Input::_readBlock(size_t readSize) {
+    if (!_buffer.resize(readSize)) {
         errno = ENOMEM;
         return -1;
     }
@@ -122,14 +340,159 @@ ssize_t Input::_readAnotherBlock() {
     errno = 0;
     ssize_t readCount = read(_fd, _buffer.data(), _buffer.size());
 
+    ++_stats.syscalls;
+
     if (readCount <= 0) {
         return readCount;
     }
 
+    _accountRead(readCount, readSize);
+
     _buffer.resize(readCount);
 
-    _prevNewline = reinterpret_cast<char *>(_buffer.data());
+    _blockStart = reinterpret_cast<char *>(_buffer.data());
+    _blockEnd = _blockStart + _buffer.size();
+    _prevNewline = _blockStart;
 
     return readCount;
 }
 
+ssize_t Input::_readAheadBlock() {
+    char *data;
+    size_t readSize;
+    ssize_t readCount = _readAhead->next(&data, &readSize);
+
+    ++_stats.syscalls;
+
+    if (readCount <= 0) {
+        return readCount;
+    }
+
+    _accountRead(readCount, readSize);
+
+    /* blocks being filled right now keep the former size */
+    _readAhead->readSize(_stats.readSize);
+
+    _blockStart = data;
+    _blockEnd = data + readCount;
+    _prevNewline = _blockStart;
+
+    return readCount;
+}
+
+void Input::_accountRead(size_t readCount, size_t readSize) {
+    _stats.bytes += readCount;
+
+    if (readCount == readSize) {
+        ++_stats.fullReads;
+
+        /* the input keeps up, read more at once */
+        if (++_consecutiveFullReads >= FULL_READS_TO_GROW &&
+            readSize == _stats.readSize &&
+            _stats.readSize < _readSizeCeiling) {
+            _stats.readSize *= 2;
+            if (_stats.readSize > _readSizeCeiling) {
+                _stats.readSize = _readSizeCeiling;
+            }
+
+            _consecutiveFullReads = 0;
+        }
+    }
+    else {
+        _consecutiveFullReads = 0;
+    }
+}
+
+bool Input::_setupMapping() {
+    struct stat st;
+
+    if (fstat(_fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+
+    /* start off where the descriptor currently points to */
+    off_t current = lseek(_fd, 0, SEEK_CUR);
+    if (current < 0) {
+        return false;
+    }
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+
+    /* at least two pages to make progress with unaligned offset */
+    _maxMapSize -= _maxMapSize % pageSize;
+    if (_maxMapSize < 2 * pageSize) {
+        _maxMapSize = 2 * pageSize;
+    }
+
+    _fileOffset = current;
+    _fileSize = st.st_size;
+
+    return true;
+}
+
+ssize_t Input::_mapBlock() {
+    errno = 0;
+
+    _unmap();
+
+    if (_fileOffset >= _fileSize) {
+        /* the file might have grown since */
+        struct stat st;
+
+        if (fstat(_fd, &st) < 0) {
+            return -1;
+        }
+
+        _fileSize = st.st_size;
+
+        if (_fileOffset >= _fileSize) {
+            return 0;
+        }
+    }
+
+    off_t pageSize = sysconf(_SC_PAGESIZE);
+    off_t mapOffset = _fileOffset - _fileOffset % pageSize;
+    size_t delta = _fileOffset - mapOffset;
+    size_t length = _fileSize - mapOffset;
+
+    if (length > _maxMapSize) {
+        length = _maxMapSize;
+    }
+
+    void *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, _fd, mapOffset);
+
+    ++_stats.syscalls;
+
+    if (MAP_FAILED == map) {
+        return -1;
+    }
+
+    _stats.bytes += length - delta;
+
+    /* just a hint, failure is not fatal */
+    madvise(map, length, MADV_SEQUENTIAL);
+
+    _map = map;
+    _mapLength = length;
+    _fileOffset = mapOffset + length;
+
+    _blockStart = reinterpret_cast<char *>(_map) + delta;
+    _blockEnd = reinterpret_cast<char *>(_map) + length;
+    _prevNewline = _blockStart;
+
+    return length - delta;
+}
+
+void Input::_resetBlock() {
+    _blockStart = reinterpret_cast<char *>(_buffer.data());
+    _blockEnd = _blockStart;
+    _prevNewline = _blockEnd;
+}
+
+void Input::_unmap() {
+    if (_map) {
+        munmap(_map, _mapLength);
+        _map = NULL;
+        _mapLength = 0;
+    }
+}
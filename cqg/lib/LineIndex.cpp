@@ -0,0 +1,381 @@
+#include "LineIndex.h"
+#include "Buffer.h"
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+
+namespace {
+
+const char MAGIC[8] = { 'C', 'Q', 'G', 'L', 'I', 'D', 'X', '\0' };
+const uint32_t VERSION = 1;
+const size_t BUILD_READ_SIZE = 1 << 20;
+
+struct Header {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    delim;
+    uint64_t    fileSize;
+    int64_t     mtimeSec;
+    int64_t     mtimeNsec;
+    uint64_t    lines;
+    uint64_t    interval;
+    uint64_t    checkpoints;
+    uint64_t    deltas;
+};
+
+/**
+ * \return \c false if the varint runs past \c size or 64 bits
+ */
+bool decode(const uint8_t *data, size_t size, uint64_t *position, uint64_t *value) {
+    unsigned shift = 0;
+    uint8_t byte;
+
+    *value = 0;
+
+    do {
+        if (*position >= size || shift >= 64) {
+            return false;
+        }
+
+        byte = data[(*position)++];
+        *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return true;
+}
+
+bool writeAll(int fd, const void *data, size_t length) {
+    const char *ptr = reinterpret_cast<const char *>(data);
+
+    while (length) {
+        ssize_t written = write(fd, ptr, length);
+
+        if (written < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            return false;
+        }
+
+        ptr += written;
+        length -= written;
+    }
+
+    return true;
+}
+
+bool readAll(int fd, void *data, size_t length) {
+    char *ptr = reinterpret_cast<char *>(data);
+
+    while (length) {
+        ssize_t readCount = read(fd, ptr, length);
+
+        if (readCount < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            return false;
+        }
+
+        if (!readCount) {
+            errno = EINVAL;
+            return false;
+        }
+
+        ptr += readCount;
+        length -= readCount;
+    }
+
+    return true;
+}
+
+}   /* namespace */
+
+LineIndex::LineIndex(char delim)
+: _delim(delim)
+{
+    _clear();
+}
+
+void LineIndex::_clear() {
+    _lines = 0;
+    _fileSize = 0;
+    _mtimeSec = 0;
+    _mtimeNsec = 0;
+    _deltas.clear();
+    _checkpoints.assign(1, Checkpoint{0, 0});
+}
+
+void LineIndex::_append(uint64_t delta, uint64_t start) {
+    do {
+        uint8_t byte = delta & 0x7f;
+
+        delta >>= 7;
+        _deltas.push_back(delta ? byte | 0x80 : byte);
+    } while (delta);
+
+    /* line number _lines + 1 starts at start */
+    if (!(++_lines % CHECKPOINT_INTERVAL)) {
+        _checkpoints.push_back(Checkpoint{start, _deltas.size()});
+    }
+}
+
+bool LineIndex::_matches(int fd) const {
+    struct stat st;
+
+    if (fstat(fd, &st) < 0) {
+        return false;
+    }
+
+    return static_cast<uint64_t>(st.st_size) == _fileSize &&
+           st.st_mtim.tv_sec == _mtimeSec &&
+           st.st_mtim.tv_nsec == _mtimeNsec;
+}
+
+bool LineIndex::build(int fd) {
+    struct stat st;
+
+    _clear();
+
+    if (fstat(fd, &st) < 0) {
+        return false;
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        errno = ESPIPE;
+        return false;
+    }
+
+    Buffer buffer(BUILD_READ_SIZE, Buffer::Growth::page_aligned);
+    const char *data = reinterpret_cast<const char *>(buffer.data());
+    uint64_t offset = 0;
+    uint64_t lineStart = 0;
+
+    while (true) {
+        ssize_t readCount = pread(fd, buffer.data(), BUILD_READ_SIZE, offset);
+
+        if (readCount < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            _clear();
+            return false;
+        }
+
+        if (!readCount) {
+            break;
+        }
+
+        const char *ptr = data;
+        const char *end = data + readCount;
+
+        while (const char *nl = reinterpret_cast<const char *>(
+                                    memchr(ptr, _delim, end - ptr))) {
+            uint64_t start = offset + (nl - data) + 1;
+
+            _append(start - lineStart, start);
+            lineStart = start;
+            ptr = nl + 1;
+        }
+
+        offset += readCount;
+    }
+
+    _fileSize = st.st_size;
+    _mtimeSec = st.st_mtim.tv_sec;
+    _mtimeNsec = st.st_mtim.tv_nsec;
+
+    return true;
+}
+
+bool LineIndex::save(const char *path) const {
+    std::string tmpPath = std::string(path) + ".tmp";
+    Header header;
+
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.delim = static_cast<unsigned char>(_delim);
+    header.fileSize = _fileSize;
+    header.mtimeSec = _mtimeSec;
+    header.mtimeNsec = _mtimeNsec;
+    header.lines = _lines;
+    header.interval = CHECKPOINT_INTERVAL;
+    header.checkpoints = _checkpoints.size();
+    header.deltas = _deltas.size();
+
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    bool result = writeAll(fd, &header, sizeof(header)) &&
+                  writeAll(fd, _checkpoints.data(),
+                           _checkpoints.size() * sizeof(Checkpoint)) &&
+                  writeAll(fd, _deltas.data(), _deltas.size());
+
+    int savedErrno = errno;
+
+    close(fd);
+
+    if (result && rename(tmpPath.c_str(), path) < 0) {
+        savedErrno = errno;
+        result = false;
+    }
+
+    if (!result) {
+        unlink(tmpPath.c_str());
+        errno = savedErrno;
+    }
+
+    return result;
+}
+
+bool LineIndex::_valid() const {
+    if (_checkpoints.empty() ||
+        _checkpoints[0].offset || _checkpoints[0].position) {
+        return false;
+    }
+
+    for (size_t idx = 1; idx < _checkpoints.size(); ++idx) {
+        const Checkpoint &prev = _checkpoints[idx - 1];
+        const Checkpoint &checkpoint = _checkpoints[idx];
+
+        /* every line takes at least a byte of the file and of the index */
+        if (checkpoint.offset <= prev.offset || checkpoint.offset > _fileSize ||
+            checkpoint.position <= prev.position || checkpoint.position > _deltas.size()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool LineIndex::load(const char *path, int fd) {
+    Header header;
+    struct stat st;
+
+    _clear();
+
+    int sidecar = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (sidecar < 0) {
+        return false;
+    }
+
+    bool result = fstat(sidecar, &st) >= 0 &&
+                  readAll(sidecar, &header, sizeof(header));
+
+    /* sizes are checked against the sidecar before anything is allocated */
+    if (result &&
+        (memcmp(header.magic, MAGIC, sizeof(MAGIC)) ||
+         VERSION != header.version ||
+         CHECKPOINT_INTERVAL != header.interval ||
+         header.checkpoints != header.lines / CHECKPOINT_INTERVAL + 1 ||
+         header.lines > header.deltas ||
+         header.checkpoints > (st.st_size - sizeof(header)) / sizeof(Checkpoint) ||
+         header.deltas != st.st_size - sizeof(header) -
+                          header.checkpoints * sizeof(Checkpoint))) {
+        errno = EINVAL;
+        result = false;
+    }
+
+    if (result) {
+        _fileSize = header.fileSize;
+        _mtimeSec = header.mtimeSec;
+        _mtimeNsec = header.mtimeNsec;
+
+        if (header.delim != static_cast<unsigned char>(_delim) || !_matches(fd)) {
+            errno = ESTALE;
+            result = false;
+        }
+    }
+
+    if (result) {
+        _lines = header.lines;
+        _checkpoints.resize(header.checkpoints);
+        _deltas.resize(header.deltas);
+
+        result = readAll(sidecar, _checkpoints.data(),
+                         _checkpoints.size() * sizeof(Checkpoint)) &&
+                 readAll(sidecar, _deltas.data(), _deltas.size());
+
+        if (result && !_valid()) {
+            errno = EINVAL;
+            result = false;
+        }
+    }
+
+    int savedErrno = errno;
+
+    close(sidecar);
+
+    if (!result) {
+        _clear();
+        errno = savedErrno;
+    }
+
+    return result;
+}
+
+off_t LineIndex::offset(size_t line) const {
+    if (!line || line > _lines + 1) {
+        return -1;
+    }
+
+    size_t idx = (line - 1) / CHECKPOINT_INTERVAL;
+    uint64_t offset = _checkpoints[idx].offset;
+    uint64_t position = _checkpoints[idx].position;
+
+    for (size_t current = idx * CHECKPOINT_INTERVAL + 1; current < line; ++current) {
+        uint64_t delta;
+
+        if (!decode(_deltas.data(), _deltas.size(), &position, &delta)) {
+            return -1;
+        }
+
+        offset += delta;
+    }
+
+    return offset;
+}
+
+size_t LineIndex::lineAt(off_t offset) const {
+    if (offset < 0) {
+        offset = 0;
+    }
+
+    auto it = std::upper_bound(_checkpoints.begin(), _checkpoints.end(),
+                               static_cast<uint64_t>(offset),
+                               [](uint64_t value, const Checkpoint &checkpoint) {
+        return value < checkpoint.offset;
+    });
+    size_t idx = it - _checkpoints.begin() - 1;
+    size_t line = idx * CHECKPOINT_INTERVAL + 1;
+    uint64_t start = _checkpoints[idx].offset;
+    uint64_t position = _checkpoints[idx].position;
+
+    while (line <= _lines) {
+        uint64_t delta;
+
+        if (!decode(_deltas.data(), _deltas.size(), &position, &delta) ||
+            start + delta > static_cast<uint64_t>(offset)) {
+            break;
+        }
+
+        start += delta;
+        ++line;
+    }
+
+    return line;
+}
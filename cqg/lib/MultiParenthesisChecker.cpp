@@ -0,0 +1,114 @@
+#include "MultiParenthesisChecker.h"
+
+#include <string.h>
+
+MultiParenthesisChecker::MultiParenthesisChecker() {
+    reset("()");
+}
+
+MultiParenthesisChecker::~MultiParenthesisChecker() {
+    /* empty */
+}
+
+bool MultiParenthesisChecker::reset(const char *pairs) {
+    size_t length = strlen(pairs);
+    int8_t klass[256];
+
+    if (!length || length % 2 || length / 2 > MAX_PAIRS) {
+        return false;
+    }
+
+    memset(klass, 0, sizeof(klass));
+
+    for (size_t idx = 0; idx < length; ++idx) {
+        uint8_t chr = static_cast<uint8_t>(pairs[idx]);
+
+        if (klass[chr]) {
+            return false;
+        }
+
+        int8_t pair = static_cast<int8_t>(idx / 2 + 1);
+        klass[chr] = idx % 2 ? -pair : pair;
+    }
+
+    memcpy(_class, klass, sizeof(_class));
+
+    for (size_t idx = 0; idx < length / 2; ++idx) {
+        _closing[idx] = pairs[2 * idx + 1];
+    }
+
+    reset();
+
+    return true;
+}
+
+void MultiParenthesisChecker::reset() {
+    _stack.clear();
+    _context = Context();
+}
+
+bool MultiParenthesisChecker::validate(const char *str, size_t length) {
+    if (Failure::none != _context.failure) {
+        return false;
+    }
+
+    const uint8_t *current = reinterpret_cast<const uint8_t *>(str);
+    const uint8_t *last = current + length;
+
+    for (; current != last; ++current) {
+        int8_t klass = _class[*current];
+
+        if (!klass) {
+            continue;
+        }
+
+        if (klass > 0) {
+            if (!_stack.push(static_cast<uint8_t>(klass))) {
+                _context.failure = Failure::no_memory;
+                break;
+            }
+
+            continue;
+        }
+
+        if (_stack.empty()) {
+            _context.failure = Failure::superfluous;
+            break;
+        }
+
+        if (_stack.top() != static_cast<uint8_t>(-klass)) {
+            _context.failure = Failure::mismatch;
+            _context.expected = _closing[_stack.top() - 1];
+            break;
+        }
+
+        _stack.pop();
+    }
+
+    _context.openIndex = _stack.size();
+
+    if (Failure::none != _context.failure) {
+        /* count the failing character in */
+        _context.position += current - reinterpret_cast<const uint8_t *>(str) + 1;
+        return false;
+    }
+
+    _context.position += length;
+
+    return true;
+}
+
+bool MultiParenthesisChecker::done() {
+    if (Failure::none != _context.failure) {
+        return false;
+    }
+
+    if (_stack.empty()) {
+        return true;
+    }
+
+    _context.failure = Failure::lack;
+    _context.expected = _closing[_stack.top() - 1];
+
+    return false;
+}
@@ -0,0 +1,93 @@
+#include "Output.h"
+
+#include <unistd.h>
+#include <errno.h>
+
+Output::Output(int fd, size_t flushSize, size_t flushLines)
+: _fd(fd),
+  _buffer(flushSize ? flushSize : 1),
+  _flushSize(flushSize ? flushSize : 1),
+  _flushLines(flushLines),
+  _lines(0),
+  _failed(false),
+  _error(0)
+{
+    /* empty */
+}
+
+Output::~Output() {
+    flush();
+}
+
+Output &Output::append(const char *str, size_t length) {
+    if (_buffer.offset() + length > _flushSize) {
+        flush();
+    }
+
+    if (length > _flushSize) {
+        _write(str, length);
+        return *this;
+    }
+
+    memcpy(_tail(), str, length);
+    _buffer.shift(length);
+
+    return *this;
+}
+
+Output &Output::append(size_t number) {
+    char digits[24];
+    char *start = digits + sizeof(digits);
+
+    do {
+        *--start = '0' + number % 10;
+        number /= 10;
+    } while (number);
+
+    return append(start, digits + sizeof(digits) - start);
+}
+
+bool Output::endLine() {
+    append('\n');
+
+    if (_flushLines && ++_lines >= _flushLines) {
+        return flush();
+    }
+
+    return !_failed;
+}
+
+bool Output::flush() {
+    _lines = 0;
+
+    if (!_buffer.offset()) {
+        return !_failed;
+    }
+
+    bool result = _write(reinterpret_cast<const char *>(_buffer.data()),
+                         _buffer.offset());
+    _buffer.offset(0);
+
+    return result;
+}
+
+bool Output::_write(const char *data, size_t length) {
+    while (length && !_failed) {
+        ssize_t written = write(_fd, data, length);
+
+        if (written < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            _failed = true;
+            _error = errno;
+            break;
+        }
+
+        data += written;
+        length -= written;
+    }
+
+    return !_failed;
+}
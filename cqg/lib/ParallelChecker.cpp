@@ -0,0 +1,312 @@
+#include "ParallelChecker.h"
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+ParallelChecker::ParallelChecker(size_t threads,
+                                 size_t blockSize,
+                                 char delim)
+: _delim(delim),
+  _blockSize(blockSize ? blockSize : DEFAULT_BLOCK_SIZE),
+  _stop(false),
+  _line(1),
+  _lineFailed(false)
+{
+    if (!threads) {
+        threads = 1;
+    }
+
+    /* let reading run ahead of stitching */
+    for (size_t idx = 0; idx < 2 * threads; ++idx) {
+        _blocks.emplace_back(new Block(_blockSize));
+    }
+
+    for (size_t idx = 0; idx < threads; ++idx) {
+        _workers.emplace_back(&ParallelChecker::_worker, this);
+    }
+}
+
+ParallelChecker::~ParallelChecker() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+
+    _taskCv.notify_all();
+
+    for (std::thread &worker : _workers) {
+        worker.join();
+    }
+}
+
+bool ParallelChecker::reset(char opening, char closing) {
+    if (opening == closing) {
+        return false;
+    }
+
+    _scanner.brackets(opening, closing);
+
+    _line = 1;
+    _lineFailed = false;
+    _context = ParenthesisChecker::Context();
+
+    return true;
+}
+
+bool ParallelChecker::run(int fd, const LineCallback &callback,
+                          const LineIndex *index) {
+    off_t offset = index ? lseek(fd, 0, SEEK_CUR) : 0;
+    size_t nextRead = 0;
+    size_t nextStitch = 0;
+    bool eof = false;
+    bool result = true;
+    int readErrno = 0;
+
+    while (true) {
+        while (!eof && nextRead - nextStitch < _blocks.size()) {
+            Block *block = _blocks[nextRead % _blocks.size()].get();
+            ssize_t bytesRead = _fill(fd, block, _blockLength(index, offset));
+
+            if (bytesRead <= 0) {
+                if (bytesRead < 0) {
+                    readErrno = errno;
+                    result = false;
+                }
+
+                eof = true;
+                break;
+            }
+
+            offset += bytesRead;
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                block->done = false;
+                _tasks.push_back(block);
+            }
+
+            _taskCv.notify_one();
+
+            ++nextRead;
+        }
+
+        if (nextStitch == nextRead) {
+            break;
+        }
+
+        Block *block = _blocks[nextStitch % _blocks.size()].get();
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _doneCv.wait(lock, [block]() {
+                return block->done;
+            });
+        }
+
+        _stitch(block, callback);
+        ++nextStitch;
+    }
+
+    errno = readErrno;
+
+    return result;
+}
+
+size_t ParallelChecker::_blockLength(const LineIndex *index, off_t offset) const {
+    if (!index || offset < 0) {
+        return _blockSize;
+    }
+
+    off_t lineStart = index->offset(index->lineAt(offset + _blockSize));
+
+    /* a line longer than the block is stitched as usual */
+    if (lineStart <= offset) {
+        return _blockSize;
+    }
+
+    return lineStart - offset;
+}
+
+ssize_t ParallelChecker::_fill(int fd, Block *block, size_t length) {
+    char *data = reinterpret_cast<char *>(block->data.data());
+    size_t filled = 0;
+
+    while (filled < length) {
+        ssize_t readCount = read(fd, data + filled, length - filled);
+
+        if (readCount < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            return readCount;
+        }
+
+        if (!readCount) {
+            break;
+        }
+
+        filled += readCount;
+    }
+
+    block->length = filled;
+
+    return filled;
+}
+
+void ParallelChecker::_worker() {
+    while (true) {
+        Block *block;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _taskCv.wait(lock, [this]() {
+                return _stop || !_tasks.empty();
+            });
+
+            if (_stop) {
+                return;
+            }
+
+            block = _tasks.front();
+            _tasks.pop_front();
+        }
+
+        _analyze(block);
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            block->done = true;
+        }
+
+        _doneCv.notify_all();
+    }
+}
+
+ParallelChecker::Segment ParallelChecker::_summarize(const char *str,
+                                                     size_t length) const {
+    Segment segment;
+    ssize_t depth = 0;
+
+    segment.length = length;
+
+    while (length) {
+        size_t scanned = _scanner.scan(str, length, &depth);
+
+        if (scanned == length) {
+            break;
+        }
+
+        /* reset depth to nil i.e. leave it as is and skip the bracket */
+        ++segment.failures;
+        str += scanned + 1;
+        length -= scanned + 1;
+    }
+
+    segment.depth = depth;
+
+    return segment;
+}
+
+void ParallelChecker::_analyze(Block *block) const {
+    const char *start = reinterpret_cast<const char *>(block->data.data());
+    const char *end = start + block->length;
+    const char *nl = reinterpret_cast<const char *>(memchr(start, _delim, block->length));
+
+    block->lines.clear();
+    block->hasNewline = !!nl;
+    block->tailFailed = false;
+    block->tail = ParenthesisChecker::Context();
+
+    if (!nl) {
+        block->head = _summarize(start, block->length);
+        return;
+    }
+
+    block->head = _summarize(start, nl - start);
+
+    const char *line = nl + 1;
+
+    while (line < end) {
+        nl = reinterpret_cast<const char *>(memchr(line, _delim, end - line));
+
+        size_t length = (nl ? nl : end) - line;
+        ssize_t depth = 0;
+        size_t scanned = _scanner.scan(line, length, &depth);
+        ParenthesisChecker::Context context;
+
+        context.openIndex = depth;
+        context.position = scanned < length ? scanned + 1 : length;
+
+        if (!nl) {
+            /* the line continues in the next block */
+            block->tailFailed = scanned < length;
+            block->tail = context;
+            return;
+        }
+
+        block->lines.push_back(LineOutcome{scanned == length && !depth, context});
+
+        line = nl + 1;
+    }
+}
+
+void ParallelChecker::_continueLine(const char *str, const Segment &segment,
+                                    const LineCallback &callback) {
+    if (_lineFailed) {
+        return;
+    }
+
+    ssize_t depth = _context.openIndex;
+
+    if (segment.failures > static_cast<size_t>(depth)) {
+        /* failure is within the segment, find out where exactly */
+        size_t scanned = _scanner.scan(str, segment.length, &depth);
+
+        _context.openIndex = depth;
+        _context.position += scanned + 1;
+        _lineFailed = true;
+
+        callback(_line, false, _context);
+        return;
+    }
+
+    _context.openIndex = depth + segment.depth - segment.failures;
+    _context.position += segment.length;
+}
+
+void ParallelChecker::_finishLine(const LineCallback &callback) {
+    if (!_lineFailed) {
+        callback(_line, !_context.openIndex, _context);
+    }
+
+    ++_line;
+    _lineFailed = false;
+    _context = ParenthesisChecker::Context();
+}
+
+void ParallelChecker::_stitch(Block *block, const LineCallback &callback) {
+    const char *start = reinterpret_cast<const char *>(block->data.data());
+
+    _continueLine(start, block->head, callback);
+
+    if (!block->hasNewline) {
+        return;
+    }
+
+    _finishLine(callback);
+
+    for (const LineOutcome &outcome : block->lines) {
+        callback(_line, outcome.valid, outcome.context);
+        ++_line;
+    }
+
+    /* the line after the last delimiter if any */
+    _context = block->tail;
+
+    if (block->tailFailed) {
+        _lineFailed = true;
+        callback(_line, false, _context);
+    }
+}
@@ -0,0 +1,608 @@
+#include "ReadAhead.h"
+
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <linux/io_uring.h>
+
+#include <algorithm>
+
+/**
+ * io_uring mapped into the process, no liburing.
+ *
+ * Head and tail indices shared with the kernel are accessed with
+ * acquire and release atomics, the ones owned by this side (SQ tail,
+ * CQ head) are only read plainly.
+ */
+struct ReadAhead::Ring {
+    int                 fd          = -1;
+    unsigned            features    = 0;
+
+    void                *sqMap      = MAP_FAILED;
+    size_t              sqMapSize   = 0;
+    void                *cqMap      = MAP_FAILED;
+    size_t              cqMapSize   = 0;
+    void                *sqeMap     = MAP_FAILED;
+    size_t              sqeMapSize  = 0;
+
+    unsigned            *sqHead     = NULL;
+    unsigned            *sqTail     = NULL;
+    unsigned            *sqArray    = NULL;
+    unsigned            sqMask      = 0;
+    unsigned            sqEntries   = 0;
+    struct io_uring_sqe *sqes       = NULL;
+
+    unsigned            *cqHead     = NULL;
+    unsigned            *cqTail     = NULL;
+    unsigned            cqMask      = 0;
+    struct io_uring_cqe *cqes       = NULL;
+
+    ~Ring() {
+        if (sqeMap != MAP_FAILED) {
+            munmap(sqeMap, sqeMapSize);
+        }
+
+        if (cqMap != MAP_FAILED && cqMap != sqMap) {
+            munmap(cqMap, cqMapSize);
+        }
+
+        if (sqMap != MAP_FAILED) {
+            munmap(sqMap, sqMapSize);
+        }
+
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    /**
+     * Queue a submission entry, the ring is sized for a poll and a read
+     * of every block and their cancellations so it never overflows
+     */
+    struct io_uring_sqe *push() {
+        unsigned tail = *sqTail;
+        unsigned idx = tail & sqMask;
+        struct io_uring_sqe *sqe = &sqes[idx];
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[idx] = idx;
+
+        return sqe;
+    }
+
+    void publish() {
+        __atomic_store_n(sqTail, *sqTail + 1, __ATOMIC_RELEASE);
+    }
+};
+
+/* user data of a poll, that of the read it's linked to with the low bit set */
+static const uintptr_t POLL_TAG = 1;
+
+static int ioUringSetup(unsigned entries, struct io_uring_params *params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+ReadAhead::ReadAhead(int fd, size_t buffers, size_t readSize, Backend backend)
+: _fd(fd),
+  _wakeFd(-1),
+  _readSize(readSize),
+  _current(NULL),
+  _stop(false),
+  _offset(-1),
+  _generation(0),
+  _queued(0),
+  _inFlight(0),
+  _started(false),
+  _pollFirst(false),
+  _error(0)
+{
+    if (!buffers) {
+        buffers = 1;
+    }
+
+    for (size_t idx = 0; idx < buffers; ++idx) {
+        _blocks.emplace_back(new Block);
+        _free.push_back(_blocks.back().get());
+    }
+
+    /* a poll, a read and their cancellations for every block */
+    if (Backend::io_uring == backend && !_setupRing(4 * buffers)) {
+        _ring.reset();
+    }
+
+    if (!_ring) {
+        _wakeFd = eventfd(0, EFD_CLOEXEC);
+    }
+}
+
+ReadAhead::~ReadAhead() {
+    if (_ring) {
+        _cancel();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+
+    _freeCv.notify_all();
+
+    if (_wakeFd >= 0) {
+        uint64_t one = 1;
+        ssize_t written = write(_wakeFd, &one, sizeof(one));
+        (void)written;
+    }
+
+    if (_reader.joinable()) {
+        _reader.join();
+    }
+
+    if (_wakeFd >= 0) {
+        close(_wakeFd);
+    }
+}
+
+const char *ReadAhead::backendName(Backend backend) {
+    return Backend::io_uring == backend ? "io_uring" : "thread";
+}
+
+bool ReadAhead::supported(Backend backend) {
+    if (Backend::thread == backend) {
+        return true;
+    }
+
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+
+    int fd = ioUringSetup(1, &params);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    close(fd);
+
+    return true;
+}
+
+void ReadAhead::readSize(size_t readSize) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _readSize = readSize;
+}
+
+ssize_t ReadAhead::next(char **data, size_t *requested) {
+    if (_ring) {
+        return _nextCompleted(data, requested);
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    if (_current) {
+        if (_current->length <= 0) {
+            /* nothing more to come */
+            return _deliver(data, requested);
+        }
+
+        _free.push_back(_current);
+        _current = NULL;
+        _freeCv.notify_one();
+    }
+
+    if (!_reader.joinable()) {
+        _reader = std::thread(&ReadAhead::_read, this);
+    }
+
+    _filledCv.wait(lock, [this]() { return !_filled.empty(); });
+
+    _current = _filled.front();
+    _filled.pop_front();
+
+    return _deliver(data, requested);
+}
+
+ssize_t ReadAhead::_deliver(char **data, size_t *requested) {
+    *data = reinterpret_cast<char *>(_current->data.data());
+    *requested = _current->requested;
+    errno = _current->error;
+
+    return _current->length;
+}
+
+void ReadAhead::_read() {
+    while (true) {
+        Block *block;
+        size_t readSize;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            _freeCv.wait(lock, [this]() { return _stop || !_free.empty(); });
+
+            if (_stop) {
+                return;
+            }
+
+            block = _free.front();
+            _free.pop_front();
+            readSize = _readSize;
+        }
+
+        ssize_t readCount = _readBlock(block, readSize);
+
+        if (readCount < 0 && ECANCELED == errno) {
+            return;
+        }
+
+        block->length = readCount;
+        block->requested = readSize;
+        block->error = readCount < 0 ? errno : 0;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _filled.push_back(block);
+        }
+
+        _filledCv.notify_one();
+
+        if (readCount <= 0) {
+            return;
+        }
+    }
+}
+
+ssize_t ReadAhead::_readBlock(Block *block, size_t readSize) {
+    if (!block->data.resize(readSize)) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    struct pollfd fds[2] = {
+        { _fd, POLLIN, 0 },
+        { _wakeFd, POLLIN, 0 },
+    };
+
+    while (true) {
+        /* regular files are always readable, nothing to wait for then */
+        int ready = poll(fds, _wakeFd >= 0 ? 2 : 1, -1);
+
+        if (ready < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            return -1;
+        }
+
+        if (fds[1].revents) {
+            errno = ECANCELED;
+            return -1;
+        }
+
+        errno = 0;
+        ssize_t readCount = read(_fd, block->data.data(), readSize);
+
+        if (readCount < 0 && (EINTR == errno || EAGAIN == errno)) {
+            continue;
+        }
+
+        return readCount;
+    }
+}
+
+/*** io_uring backend ***/
+bool ReadAhead::_setupRing(unsigned entries) {
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+
+    int fd = ioUringSetup(entries, &params);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    _ring.reset(new Ring);
+
+    Ring &ring = *_ring;
+
+    ring.fd = fd;
+    ring.features = params.features;
+    ring.sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    /* both rings share a mapping since 5.4 */
+    if (ring.features & IORING_FEAT_SINGLE_MMAP) {
+        ring.sqMapSize = ring.cqMapSize = std::max(ring.sqMapSize, ring.cqMapSize);
+    }
+
+    ring.sqMap = mmap(NULL, ring.sqMapSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == ring.sqMap) {
+        return false;
+    }
+
+    if (ring.features & IORING_FEAT_SINGLE_MMAP) {
+        ring.cqMap = ring.sqMap;
+    }
+    else {
+        ring.cqMap = mmap(NULL, ring.cqMapSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == ring.cqMap) {
+            return false;
+        }
+    }
+
+    ring.sqeMapSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring.sqeMap = mmap(NULL, ring.sqeMapSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (MAP_FAILED == ring.sqeMap) {
+        return false;
+    }
+
+    char *sq = static_cast<char *>(ring.sqMap);
+    char *cq = static_cast<char *>(ring.cqMap);
+
+    ring.sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    ring.sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    ring.sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    ring.sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    ring.sqEntries = params.sq_entries;
+    ring.sqes = static_cast<struct io_uring_sqe *>(ring.sqeMap);
+
+    ring.cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    ring.cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    ring.cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    ring.cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+bool ReadAhead::_fill() {
+    bool stream = _offset < 0;
+
+    /* a stream has a single read in flight, concurrent ones might
+     * take the data out of order */
+    while (!_free.empty() && (!stream || !_inFlight)) {
+        Block *block = _free.front();
+
+        if (!block->data.resize(_readSize)) {
+            errno = ENOMEM;
+            return false;
+        }
+
+        _free.pop_front();
+
+        block->requested = _readSize;
+        block->offset = _offset;
+        block->generation = _generation;
+        block->completed = false;
+        block->iov.iov_base = block->data.data();
+        block->iov.iov_len = _readSize;
+
+        if (!stream) {
+            _offset += _readSize;
+        }
+
+        struct io_uring_sqe *sqe;
+
+        if (_pollFirst) {
+            /* a non-blocking stream fails reads with EAGAIN instead of
+             * waiting, let the read wait for the data behind a poll */
+            sqe = _ring->push();
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = _fd;
+            sqe->poll_events = POLLIN;
+            sqe->flags = IOSQE_IO_LINK;
+            sqe->user_data = reinterpret_cast<uintptr_t>(block) | POLL_TAG;
+
+            _ring->publish();
+            ++_queued;
+        }
+
+        sqe = _ring->push();
+
+        /* readv rather than read to run on any kernel having io_uring */
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = _fd;
+        sqe->addr = reinterpret_cast<uintptr_t>(&block->iov);
+        sqe->len = 1;
+        /* the current position before 5.6 is only known for streams */
+        sqe->off = block->offset >= 0 || (_ring->features & IORING_FEAT_RW_CUR_POS) ?
+                       block->offset : 0;
+        sqe->user_data = reinterpret_cast<uintptr_t>(block);
+
+        _ring->publish();
+        _submitted.push_back(block);
+        ++_queued;
+        ++_inFlight;
+    }
+
+    return true;
+}
+
+bool ReadAhead::_enter(unsigned minComplete) {
+    if (!_queued && !minComplete) {
+        _reap();
+        return true;
+    }
+
+    while (true) {
+        int submitted = ioUringEnter(_ring->fd, _queued, minComplete,
+                                     minComplete ? IORING_ENTER_GETEVENTS : 0);
+
+        if (submitted < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            return false;
+        }
+
+        /* interrupted waiting, the caller checks for the completions */
+        _queued -= submitted;
+        _reap();
+
+        return true;
+    }
+}
+
+void ReadAhead::_reap() {
+    Ring &ring = *_ring;
+    unsigned head = *ring.cqHead;
+    unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++head) {
+        const struct io_uring_cqe &cqe = ring.cqes[head & ring.cqMask];
+
+        /* cancellations carry no block, the reads tell the outcome of polls */
+        if (!cqe.user_data || (cqe.user_data & POLL_TAG)) {
+            continue;
+        }
+
+        Block *block = reinterpret_cast<Block *>(static_cast<uintptr_t>(cqe.user_data));
+
+        block->length = cqe.res < 0 ? -1 : cqe.res;
+        block->error = cqe.res < 0 ? -cqe.res : 0;
+        block->completed = true;
+        --_inFlight;
+    }
+
+    __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+}
+
+ssize_t ReadAhead::_nextCompleted(char **data, size_t *requested) {
+    if (_error) {
+        *data = NULL;
+        *requested = 0;
+        errno = _error;
+        return -1;
+    }
+
+    if (_current) {
+        if (_current->length <= 0) {
+            /* nothing more to come */
+            return _deliver(data, requested);
+        }
+
+        _free.push_back(_current);
+        _current = NULL;
+    }
+
+    if (!_started) {
+        struct stat st;
+
+        /* start off where the descriptor currently points to */
+        if (fstat(_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            _offset = lseek(_fd, 0, SEEK_CUR);
+        }
+
+        _started = true;
+    }
+
+    while (true) {
+        if (!_fill() || !_enter(0)) {
+            if (_submitted.empty()) {
+                _error = errno;
+                return _nextCompleted(data, requested);
+            }
+        }
+
+        Block *block = _submitted.front();
+
+        if (!block->completed) {
+            if (!_enter(1)) {
+                _error = errno;
+                return _nextCompleted(data, requested);
+            }
+
+            continue;
+        }
+
+        _submitted.pop_front();
+
+        if (block->generation != _generation) {
+            /* read at an offset made stale by a short read */
+            _free.push_back(block);
+            continue;
+        }
+
+        if (block->length < 0 && (EINTR == block->error || EAGAIN == block->error)) {
+            /* read the same range again, the ones after it are stale */
+            if (_offset >= 0) {
+                _offset = block->offset;
+                ++_generation;
+            }
+            else if (EAGAIN == block->error) {
+                _pollFirst = true;
+            }
+
+            _free.push_back(block);
+            continue;
+        }
+
+        if (_offset >= 0 && block->length > 0 &&
+            static_cast<size_t>(block->length) < block->requested) {
+            /* the reads in flight past it counted on a full one */
+            _offset = block->offset + block->length;
+            ++_generation;
+        }
+
+        _current = block;
+
+        /* the next read of a stream goes while this block is processed,
+         * failures are met upon the next call */
+        if (_current->length > 0 && _fill()) {
+            _enter(0);
+        }
+
+        return _deliver(data, requested);
+    }
+}
+
+void ReadAhead::_cancel() {
+    for (Block *block : _submitted) {
+        if (block->completed) {
+            continue;
+        }
+
+        /* the poll a read is linked to first, its read is cancelled along */
+        uintptr_t targets[] = {
+            reinterpret_cast<uintptr_t>(block) | POLL_TAG,
+            reinterpret_cast<uintptr_t>(block),
+        };
+
+        for (uintptr_t target : targets) {
+            struct io_uring_sqe *sqe = _ring->push();
+
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = target;
+
+            _ring->publish();
+            ++_queued;
+        }
+    }
+
+    /* the kernel may not write into the buffers once they are freed */
+    while (_inFlight) {
+        if (!_enter(1)) {
+            for (std::unique_ptr<Block> &block : _blocks) {
+                block.release();
+            }
+
+            break;
+        }
+    }
+}
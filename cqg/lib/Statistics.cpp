@@ -0,0 +1,100 @@
+#include "Statistics.h"
+
+#include <string.h>
+
+const char Statistics::BINARY_MAGIC[8] = { 'C', 'Q', 'G', 'S', 'T', 'A', 'T', '\0' };
+
+Statistics::Statistics() {
+    memset(_depth, 0, sizeof(_depth));
+    memset(_position, 0, sizeof(_position));
+}
+
+size_t Statistics::_bucket(uint64_t value) {
+    return value ? 64 - __builtin_clzll(value) : 0;
+}
+
+uint64_t Statistics::_lowerBound(size_t bucket) {
+    return bucket ? static_cast<uint64_t>(1) << (bucket - 1) : 0;
+}
+
+void Statistics::add(bool isValid, const StatisticsChecker::Context &ctx) {
+    uint64_t maxDepth = ctx.maxDepth;
+
+    ++_totals.lines;
+    _totals.opening += ctx.opening;
+    _totals.closing += ctx.closing;
+
+    if (maxDepth > _totals.deepest) {
+        _totals.deepest = maxDepth;
+    }
+
+    ++_depth[_bucket(maxDepth)];
+
+    if (isValid) {
+        ++_totals.valid;
+        return;
+    }
+
+    if (ctx.openIndex > 0) {
+        ++_totals.lack;
+    }
+    else {
+        ++_totals.superfluous;
+    }
+
+    ++_position[_bucket(ctx.position)];
+}
+
+bool Statistics::write(Output &output, Format format) const {
+    const uint64_t *totals = &_totals.lines;
+    const size_t totalCount = sizeof(Totals) / sizeof(uint64_t);
+
+    if (Format::binary == format) {
+        uint32_t version = BINARY_VERSION;
+        uint32_t buckets = BUCKETS;
+
+        output.append(BINARY_MAGIC, sizeof(BINARY_MAGIC))
+              .append(reinterpret_cast<const char *>(&version), sizeof(version))
+              .append(reinterpret_cast<const char *>(&buckets), sizeof(buckets))
+              .append(reinterpret_cast<const char *>(totals), sizeof(Totals))
+              .append(reinterpret_cast<const char *>(_depth), sizeof(_depth))
+              .append(reinterpret_cast<const char *>(_position), sizeof(_position));
+
+        return output.flush();
+    }
+
+    static const char *TOTAL_NAMES[totalCount] = {
+        "lines", "valid", "superfluous", "lack", "opening", "closing", "deepest",
+    };
+
+    output.append("metric,bucket,count").endLine();
+
+    for (size_t idx = 0; idx < totalCount; ++idx) {
+        output.append(TOTAL_NAMES[idx])
+              .append(",,")
+              .append(static_cast<size_t>(totals[idx]))
+              .endLine();
+    }
+
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+        if (_depth[bucket]) {
+            output.append("max_depth,")
+                  .append(static_cast<size_t>(_lowerBound(bucket)))
+                  .append(',')
+                  .append(static_cast<size_t>(_depth[bucket]))
+                  .endLine();
+        }
+    }
+
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+        if (_position[bucket]) {
+            output.append("failure_position,")
+                  .append(static_cast<size_t>(_lowerBound(bucket)))
+                  .append(',')
+                  .append(static_cast<size_t>(_position[bucket]))
+                  .endLine();
+        }
+    }
+
+    return output.flush();
+}
@@ -0,0 +1,48 @@
+#include "StatisticsChecker.h"
+
+StatisticsChecker::StatisticsChecker()
+: _opening('('),
+  _closing(')'),
+  _scanner(_opening, _closing)
+{
+    /* empty */
+}
+
+bool StatisticsChecker::reset(char opening, char closing) {
+    if (opening == closing) {
+        return false;
+    }
+
+    _opening = opening;
+    _closing = closing;
+    _scanner.brackets(_opening, _closing);
+
+    _context = Context();
+
+    return true;
+}
+
+bool StatisticsChecker::validate(const char *str, size_t length) {
+    BracketScanner::Tally tally;
+
+    tally.maxDepth = _context.maxDepth;
+
+    size_t scanned = _scanner.scan(str, length, &_context.openIndex, &tally);
+
+    _context.position += scanned;
+    _context.maxDepth = tally.maxDepth;
+    _context.opening += tally.opening;
+    _context.closing += tally.closing;
+
+    if (scanned < length) {
+        /* count the failing character in */
+        ++_context.position;
+        return false;
+    }
+
+    return true;
+}
+
+bool StatisticsChecker::done() {
+    return !_context.openIndex;
+}
@@ -0,0 +1,120 @@
+#include "StreamValidator.h"
+#include "ParenthesisChecker.h"
+#include "MultiParenthesisChecker.h"
+#include "StatisticsChecker.h"
+
+#include <string.h>
+#include <errno.h>
+
+#include <linux/limits.h>
+
+template <class Checker>
+StreamValidator<Checker>::StreamValidator(char delim)
+: _delim(delim),
+  _mode(Input::Mode::mmap),
+  _readSizeCeiling(PIPE_BUF),
+  _readAheadBuffers(ReadAhead::DEFAULT_BUFFERS),
+  _readAheadBackend(ReadAhead::Backend::io_uring),
+  _line(1)
+{
+    /* empty */
+}
+
+template <class Checker>
+bool StreamValidator<Checker>::run(int fd, const LineCallback &callback,
+                                   const LineIndex *index, size_t firstLine) {
+    Input input(fd, _delim, PIPE_BUF, _mode,
+                Input::DEFAULT_MAP_WINDOW, _readAheadBuffers, _readAheadBackend);
+    char *line = NULL;
+    ssize_t len = 0;
+
+    bool newLineFound = false;
+    bool stillValid = true;
+
+    /* failure to enlarge the pipe is not fatal */
+    input.readSizeCeiling(_readSizeCeiling);
+
+    _line = 1;
+    _checker.restart();
+
+    if (firstLine > 1) {
+        if (!index) {
+            errno = EINVAL;
+            return false;
+        }
+
+        if (!input.seekLine(*index, firstLine)) {
+            return false;
+        }
+
+        _line = firstLine;
+    }
+
+    input.start(&line, &len);
+
+    while (line) {
+        stillValid = _checker.validate(line, len);
+
+        if (!stillValid) {
+            callback(_line, stillValid, _checker.getContext());
+            newLineFound = input.readUntilNewline(&line, &len, newLineFound);
+
+            _checker.restart();
+            ++_line;
+            continue;
+        }
+
+        if (newLineFound) {
+            stillValid = _checker.done();
+            callback(_line, stillValid, _checker.getContext());
+
+            _checker.restart();
+            ++_line;
+        }
+
+        newLineFound = input.readAndDetectNewline(&line, &len);
+    }
+
+    _stats = input.stats();
+
+    return !(!line && errno);
+}
+
+template <class Checker>
+bool StreamValidator<Checker>::run(const char *data, size_t length,
+                                   const LineCallback &callback) {
+    const char *end = data + length;
+
+    _line = 1;
+    _checker.restart();
+
+    while (data < end) {
+        const char *nl = reinterpret_cast<const char *>(memchr(data, _delim, end - data));
+        const char *lineEnd = nl ? nl : end;
+
+        /* the whole line at once */
+        bool stillValid = _checker.validate(data, lineEnd - data);
+
+        if (stillValid && nl) {
+            stillValid = _checker.done();
+            callback(_line, stillValid, _checker.getContext());
+        }
+        else if (!stillValid) {
+            callback(_line, stillValid, _checker.getContext());
+        }
+
+        if (!nl) {
+            break;
+        }
+
+        _checker.restart();
+        ++_line;
+        data = nl + 1;
+    }
+
+    return true;
+}
+
+template class StreamValidator<ParenthesisChecker>;
+template class StreamValidator<MultiParenthesisChecker>;
+template class StreamValidator<StatisticsChecker>;
@@ -1,91 +1,501 @@
 #include "ParenthesisChecker.h"
+#include "MultiParenthesisChecker.h"
+#include "StatisticsChecker.h"
+#include "Statistics.h"
+#include "ParallelChecker.h"
+#include "StreamValidator.h"
 #include "Input.h"
+#include "LineIndex.h"
+#include "Output.h"
 
 #include <iostream>
-#include <sstream>
 
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
 
 #define RET_OK                  0
 #define RET_READ_FAILURE        1
 #define RET_NOT_ALL_OK          2
+#define RET_INVALID_ARGS        3
+#define RET_WRITE_FAILURE       4
 
-void printStatus(size_t line, bool isValid, const ParenthesisChecker::Context &ctx) {
-    std::stringstream ss;
+#define DEFAULT_READ_SIZE_CEILING   (1 << 20)
 
+void printUsage(const char *argv0) {
+    std::cerr << "Usage: "
+              << argv0
+              << " [-i read|mmap|readahead] [-a buffers] [-r io_uring|thread] [-b bytes] [-s]"
+              << " [-j threads | -p pairs] [-o bytes] [-l lines]"
+              << " [-x sidecar [-n line]] [-t file [-f csv|binary]]"
+              << std::endl
+              << "  -i  input mode, mmap falls back to read for pipes"
+              << std::endl
+              << "  -a  number of read-ahead buffers, defaults to "
+              << ReadAhead::DEFAULT_BUFFERS
+              << std::endl
+              << "  -r  read-ahead backend, io_uring falls back to thread if the kernel"
+              << std::endl
+              << "      refuses it, defaults to io_uring"
+              << std::endl
+              << "  -b  read size ceiling, defaults to "
+              << DEFAULT_READ_SIZE_CEILING
+              << std::endl
+              << "  -s  print input statistics to stderr"
+              << std::endl
+              << "  -j  check with this many threads, -i, -b and -s are ignored then"
+              << std::endl
+              << "  -p  check several bracket pairs at once e.g. \"()[]{}\""
+              << std::endl
+              << "  -o  output flush size, defaults to "
+              << Output::DEFAULT_FLUSH_SIZE
+              << std::endl
+              << "  -l  flush output every this many lines, defaults to 1 for a terminal"
+              << std::endl
+              << "      and to 0 i.e. by flush size only otherwise"
+              << std::endl
+              << "  -x  line index sidecar of the input file, built and saved"
+              << std::endl
+              << "      if missing or stale"
+              << std::endl
+              << "  -n  start at this line, requires -x, not with -j"
+              << std::endl
+              << "  -t  gather per-line figures (max depth, bracket counts) and write"
+              << std::endl
+              << "      file aggregate and histograms to this file, not with -j or -p"
+              << std::endl
+              << "  -f  aggregate format, defaults to csv"
+              << std::endl;
+}
+
+bool parseInputMode(const char *arg, Input::Mode *mode) {
+    if (!strcmp(arg, "read")) {
+        *mode = Input::Mode::read;
+    }
+    else if (!strcmp(arg, "mmap")) {
+        *mode = Input::Mode::mmap;
+    }
+    else if (!strcmp(arg, "readahead")) {
+        *mode = Input::Mode::read_ahead;
+    }
+    else {
+        return false;
+    }
+
+    return true;
+}
+
+bool parseReadAheadBackend(const char *arg, ReadAhead::Backend *backend) {
+    if (!strcmp(arg, "io_uring")) {
+        *backend = ReadAhead::Backend::io_uring;
+    }
+    else if (!strcmp(arg, "thread")) {
+        *backend = ReadAhead::Backend::thread;
+    }
+    else {
+        return false;
+    }
+
+    return true;
+}
+
+bool parseStatisticsFormat(const char *arg, Statistics::Format *format) {
+    if (!strcmp(arg, "csv")) {
+        *format = Statistics::Format::csv;
+    }
+    else if (!strcmp(arg, "binary")) {
+        *format = Statistics::Format::binary;
+    }
+    else {
+        return false;
+    }
+
+    return true;
+}
+
+void printStats(const Input::Stats &stats) {
+    std::cerr << "Syscalls: " << stats.syscalls
+              << ", bytes: " << stats.bytes
+              << ", full reads: " << stats.fullReads
+              << ", read size: " << stats.readSize
+              << ", pipe capacity: " << stats.pipeCapacity
+              << ", skipped bytes: " << stats.skippedBytes
+              << ", syscalls per byte: " << stats.syscallsPerByte();
+
+    if (stats.readAhead) {
+        std::cerr << ", read-ahead: " << stats.readAhead;
+    }
+
+    std::cerr << std::endl;
+}
+
+void appendStatus(Output &output, size_t line, bool isValid,
+                  const ParenthesisChecker::Context &ctx) {
     if (isValid) {
-        ss << "Line "
-           << line
-           << " ok";
+        output.append("Line ")
+              .append(line)
+              .append(" ok");
     }
     else {
-        ss << "Failure at line number "
-           << line
-           << " near character number "
-           << ctx.position
-           << " due to ";
+        output.append("Failure at line number ")
+              .append(line)
+              .append(" near character number ")
+              .append(ctx.position)
+              .append(" due to ");
 
         if (ctx.openIndex > 0) {
-            ss << "lack of";
+            output.append("lack of");
         }
         else {
-            ss << "superfluous";
+            output.append("superfluous");
         }
 
-        ss << " closing bracket";
+        output.append(" closing bracket");
     }
+}
 
-    std::cout << ss.str() << std::endl;
+void printStatus(Output &output, size_t line, bool isValid,
+                 const ParenthesisChecker::Context &ctx) {
+    appendStatus(output, line, isValid, ctx);
+    output.endLine();
 }
 
-int main(int argc, char **argv) {
-    ParenthesisChecker checker;
-    Input input(STDIN_FILENO);
-    char *line = NULL;
-    ssize_t len = 0;
-    size_t lineCounter = 1;
-    bool allOk = true;
+void printStatus(Output &output, size_t line, bool isValid,
+                 const MultiParenthesisChecker::Context &ctx) {
+    if (isValid) {
+        output.append("Line ")
+              .append(line)
+              .append(" ok");
+    }
+    else {
+        output.append("Failure at line number ")
+              .append(line)
+              .append(" near character number ")
+              .append(ctx.position)
+              .append(" due to ");
+
+        switch (ctx.failure) {
+            case MultiParenthesisChecker::Failure::mismatch:
+                output.append("mismatched closing bracket, expected ")
+                      .append(ctx.expected);
+                break;
+
+            case MultiParenthesisChecker::Failure::lack:
+                output.append("lack of closing bracket ")
+                      .append(ctx.expected);
+                break;
 
-    bool newLineFound = false;
-    bool stillValid = true;
+            case MultiParenthesisChecker::Failure::no_memory:
+                output.append("too deep nesting");
+                break;
 
-    input.start(&line, &len);
+            default:
+                output.append("superfluous closing bracket");
+                break;
+        }
+    }
+
+    output.endLine();
+}
+
+bool openIndex(const char *sidecar, LineIndex &index) {
+    if (index.load(sidecar, STDIN_FILENO)) {
+        return true;
+    }
 
-    while (line) {
-        stillValid = checker.validate(line, len);
-        allOk = allOk && stillValid;
+    if (!index.build(STDIN_FILENO)) {
+        std::cerr << "Index error: "
+                  << strerror(errno)
+                  << std::endl;
+
+        return false;
+    }
+
+    /* the index is usable for this run anyway */
+    if (!index.save(sidecar)) {
+        std::cerr << "Can't save index to "
+                  << sidecar
+                  << ": "
+                  << strerror(errno)
+                  << std::endl;
+    }
+
+    return true;
+}
 
-        if (!stillValid) {
-            printStatus(lineCounter, stillValid, checker.getContext());
-            newLineFound = input.readUntilNewline(&line, &len, newLineFound);
+void printStatus(Output &output, size_t line, bool isValid,
+                 const StatisticsChecker::Context &ctx) {
+    ParenthesisChecker::Context base;
 
-            checker.reset();
-            ++lineCounter;
-            continue;
+    base.openIndex = ctx.openIndex;
+    base.position = ctx.position;
+
+    appendStatus(output, line, isValid, base);
+
+    output.append(" (max depth ")
+          .append(static_cast<size_t>(ctx.maxDepth))
+          .append(", opening ")
+          .append(ctx.opening)
+          .append(", closing ")
+          .append(ctx.closing)
+          .append(')')
+          .endLine();
+}
+
+template <class Context>
+void collect(Statistics *, bool, const Context &) {
+    /* nothing to gather */
+}
+
+void collect(Statistics *statistics, bool isValid,
+             const StatisticsChecker::Context &ctx) {
+    statistics->add(isValid, ctx);
+}
+
+bool writeStatistics(const char *path, Statistics::Format format,
+                     const Statistics &statistics) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        std::cerr << "Can't open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    bool result;
+
+    {
+        Output output(fd);
+
+        result = statistics.write(output, format);
+
+        if (!result) {
+            std::cerr << "Write error: " << strerror(output.error()) << std::endl;
         }
+    }
 
-        if (newLineFound) {
-            stillValid = checker.done();
-            allOk = allOk && stillValid;
-            printStatus(lineCounter, stillValid, checker.getContext());
+    close(fd);
 
-            checker.reset();
-            ++lineCounter;
+    return result;
+}
+
+int runParallel(size_t threads, Output &output, const LineIndex *index) {
+    ParallelChecker checker(threads);
+    bool allOk = true;
+
+    checker.reset();
+
+    bool result = checker.run(STDIN_FILENO,
+                              [&allOk, &output](size_t line, bool isValid,
+                                                const ParenthesisChecker::Context &ctx) {
+        allOk = allOk && isValid;
+        printStatus(output, line, isValid, ctx);
+    }, index);
+
+    output.flush();
+
+    if (!result) {
+        std::cerr << "Read error: "
+                  << strerror(errno)
+                  << " at line "
+                  << checker.line();
+
+        return RET_READ_FAILURE;
+    }
+
+    return allOk ? RET_OK : RET_NOT_ALL_OK;
+}
+
+template <class Checker>
+int runSerial(StreamValidator<Checker> &validator, Output &output, bool showStats,
+              const LineIndex *index, size_t firstLine,
+              Statistics *statistics = NULL) {
+    bool allOk = true;
+
+    bool result = validator.run(STDIN_FILENO,
+                                [&allOk, &output, statistics](size_t line, bool isValid,
+                                                              const typename Checker::Context &ctx) {
+        allOk = allOk && isValid;
+        printStatus(output, line, isValid, ctx);
+
+        if (statistics) {
+            collect(statistics, isValid, ctx);
         }
+    }, index, firstLine);
 
-        newLineFound = input.readAndDetectNewline(&line, &len);
+    output.flush();
+
+    if (showStats) {
+        printStats(validator.stats());
     }
 
-    if (!line && errno) {
+    if (!result) {
         std::cerr << "Read error: "
                   << strerror(errno)
                   << " at line "
-                  << lineCounter;
+                  << validator.line();
 
         return RET_READ_FAILURE;
     }
 
     return allOk ? RET_OK : RET_NOT_ALL_OK;
 }
+
+int main(int argc, char **argv) {
+    Input::Mode inputMode = Input::Mode::read;
+    size_t readSizeCeiling = DEFAULT_READ_SIZE_CEILING;
+    size_t readAheadBuffers = ReadAhead::DEFAULT_BUFFERS;
+    ReadAhead::Backend readAheadBackend = ReadAhead::Backend::io_uring;
+    bool showStats = false;
+    size_t threads = 0;
+    const char *pairs = NULL;
+    size_t flushSize = Output::DEFAULT_FLUSH_SIZE;
+    size_t flushLines = isatty(STDOUT_FILENO) ? 1 : 0;
+    const char *sidecar = NULL;
+    size_t firstLine = 1;
+    const char *statisticsPath = NULL;
+    Statistics::Format statisticsFormat = Statistics::Format::csv;
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "i:a:r:b:sj:p:o:l:x:n:t:f:"))) {
+        switch (opt) {
+            case 'i':
+                if (!parseInputMode(optarg, &inputMode)) {
+                    printUsage(argv[0]);
+                    return RET_INVALID_ARGS;
+                }
+                break;
+
+            case 'a':
+                readAheadBuffers = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'r':
+                if (!parseReadAheadBackend(optarg, &readAheadBackend)) {
+                    printUsage(argv[0]);
+                    return RET_INVALID_ARGS;
+                }
+                break;
+
+            case 'b':
+                readSizeCeiling = strtoul(optarg, NULL, 0);
+                break;
+
+            case 's':
+                showStats = true;
+                break;
+
+            case 'j':
+                threads = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'p':
+                pairs = optarg;
+                break;
+
+            case 'o':
+                flushSize = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'l':
+                flushLines = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'x':
+                sidecar = optarg;
+                break;
+
+            case 'n':
+                firstLine = strtoul(optarg, NULL, 0);
+                break;
+
+            case 't':
+                statisticsPath = optarg;
+                break;
+
+            case 'f':
+                if (!parseStatisticsFormat(optarg, &statisticsFormat)) {
+                    printUsage(argv[0]);
+                    return RET_INVALID_ARGS;
+                }
+                break;
+
+            default:
+                printUsage(argv[0]);
+                return RET_INVALID_ARGS;
+        }
+    }
+
+    if ((threads && pairs) ||
+        (statisticsPath && (threads || pairs)) ||
+        (firstLine != 1 && (!sidecar || threads || !firstLine))) {
+        printUsage(argv[0]);
+        return RET_INVALID_ARGS;
+    }
+
+    LineIndex index;
+
+    if (sidecar && !openIndex(sidecar, index)) {
+        return RET_READ_FAILURE;
+    }
+
+    const LineIndex *indexUsed = sidecar ? &index : NULL;
+    Output output(STDOUT_FILENO, flushSize, flushLines);
+    int result;
+
+    if (threads) {
+        result = runParallel(threads, output, indexUsed);
+    }
+    else if (pairs) {
+        StreamValidator<MultiParenthesisChecker> validator;
+
+        if (!validator.checker().reset(pairs)) {
+            printUsage(argv[0]);
+            return RET_INVALID_ARGS;
+        }
+
+        validator.inputMode(inputMode);
+        validator.readSizeCeiling(readSizeCeiling);
+        validator.readAheadBuffers(readAheadBuffers);
+        validator.readAheadBackend(readAheadBackend);
+
+        result = runSerial(validator, output, showStats, indexUsed, firstLine);
+    }
+    else if (statisticsPath) {
+        StreamValidator<StatisticsChecker> validator;
+        Statistics statistics;
+
+        validator.inputMode(inputMode);
+        validator.readSizeCeiling(readSizeCeiling);
+        validator.readAheadBuffers(readAheadBuffers);
+        validator.readAheadBackend(readAheadBackend);
+
+        result = runSerial(validator, output, showStats, indexUsed, firstLine,
+                           &statistics);
+
+        if (!writeStatistics(statisticsPath, statisticsFormat, statistics)) {
+            return RET_WRITE_FAILURE;
+        }
+    }
+    else {
+        StreamValidator<ParenthesisChecker> validator;
+
+        validator.inputMode(inputMode);
+        validator.readSizeCeiling(readSizeCeiling);
+        validator.readAheadBuffers(readAheadBuffers);
+        validator.readAheadBackend(readAheadBackend);
+
+        result = runSerial(validator, output, showStats, indexUsed, firstLine);
+    }
+
+    if (output.failed()) {
+        std::cerr << "Write error: "
+                  << strerror(output.error())
+                  << std::endl;
+
+        return RET_WRITE_FAILURE;
+    }
+
+    return result;
+}
@@ -0,0 +1,199 @@
+/**
+ * LineIndex sidecar test.
+ *
+ * Builds and saves an index of a generated file, then damages copies
+ * of the sidecar and checks that each is refused with \c EINVAL
+ * instead of being trusted, and that a rebuild works after that.
+ */
+#include "LineIndex.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RET_OK                  0
+#define RET_FAILURE             1
+
+#define LINE_COUNT              3000
+
+/* sidecar layout, host byte order */
+#define HEADER_SIZE             72
+#define HEADER_LINES            40
+#define HEADER_DELTAS           64
+#define CHECKPOINT_SIZE         16
+
+static unsigned failures = 0;
+
+static void check(bool condition, const char *what) {
+    if (!condition) {
+        std::cerr << "FAIL: " << what << std::endl;
+        ++failures;
+    }
+}
+
+static std::string readFile(const std::string &path) {
+    std::string data;
+    char chunk[4096];
+    int fd = open(path.c_str(), O_RDONLY);
+    ssize_t readCount;
+
+    while (fd >= 0 && (readCount = read(fd, chunk, sizeof(chunk))) > 0) {
+        data.append(chunk, readCount);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return data;
+}
+
+static void writeFile(const std::string &path, const std::string &data) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0 || write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size())) {
+        std::cerr << "Can't write " << path << ": " << strerror(errno) << std::endl;
+        exit(RET_FAILURE);
+    }
+
+    close(fd);
+}
+
+static void put64(std::string &data, size_t at, uint64_t value) {
+    memcpy(&data[at], &value, sizeof(value));
+}
+
+/**
+ * Load a damaged sidecar, it must be refused as malformed
+ */
+static void expectInvalid(const std::string &path, const std::string &sidecar,
+                          int fd, const char *what) {
+    LineIndex index;
+
+    writeFile(path, sidecar);
+    errno = 0;
+
+    check(!index.load(path.c_str(), fd) && EINVAL == errno, what);
+    check(0 == index.lines() && 0 == index.offset(1), what);
+}
+
+int main() {
+    char dir[] = "/tmp/cqg-line-index.XXXXXX";
+
+    if (!mkdtemp(dir)) {
+        std::cerr << "Can't create directory: " << strerror(errno) << std::endl;
+        return RET_FAILURE;
+    }
+
+    std::string input = std::string(dir) + "/input";
+    std::string path = std::string(dir) + "/input.idx";
+    std::string damaged = std::string(dir) + "/damaged.idx";
+    std::string data;
+    std::vector<off_t> offsets;
+
+    for (size_t line = 0; line < LINE_COUNT; ++line) {
+        offsets.push_back(data.size());
+        data.append(1 + line % 300, '(');
+        data.push_back('\n');
+    }
+
+    offsets.push_back(data.size());
+    data.append("tail");
+    writeFile(input, data);
+
+    int fd = open(input.c_str(), O_RDONLY);
+    LineIndex built;
+
+    check(fd >= 0 && built.build(fd) && built.save(path.c_str()), "build and save");
+
+    LineIndex loaded;
+
+    check(loaded.load(path.c_str(), fd), "load of a good sidecar");
+    check(LINE_COUNT == loaded.lines(), "line count");
+
+    for (size_t line = 1; line <= LINE_COUNT + 1; ++line) {
+        if (offsets[line - 1] != loaded.offset(line) ||
+            line != loaded.lineAt(offsets[line - 1])) {
+            check(false, "offsets of a good sidecar");
+            break;
+        }
+    }
+
+    std::string sidecar = readFile(path);
+    std::string copy;
+
+    check(sidecar.size() > HEADER_SIZE + 2 * CHECKPOINT_SIZE, "sidecar size");
+
+    copy = sidecar.substr(0, sidecar.size() - 1);
+    expectInvalid(damaged, copy, fd, "truncated deltas");
+
+    copy = sidecar.substr(0, HEADER_SIZE + CHECKPOINT_SIZE / 2);
+    expectInvalid(damaged, copy, fd, "truncated checkpoints");
+
+    copy = sidecar.substr(0, HEADER_SIZE / 2);
+    expectInvalid(damaged, copy, fd, "truncated header");
+
+    copy = sidecar;
+    put64(copy, HEADER_DELTAS, 1ULL << 40);
+    expectInvalid(damaged, copy, fd, "huge delta count");
+
+    copy = sidecar;
+    put64(copy, HEADER_LINES, 1ULL << 50);
+    put64(copy, HEADER_DELTAS, 1ULL << 52);
+    expectInvalid(damaged, copy, fd, "huge line count");
+
+    copy = sidecar;
+    put64(copy, HEADER_SIZE, 1);
+    expectInvalid(damaged, copy, fd, "first checkpoint off zero");
+
+    copy = sidecar;
+    put64(copy, HEADER_SIZE + CHECKPOINT_SIZE + 8, sidecar.size());
+    expectInvalid(damaged, copy, fd, "checkpoint past deltas");
+
+    copy = sidecar;
+    put64(copy, HEADER_SIZE + 2 * CHECKPOINT_SIZE, 0);
+    expectInvalid(damaged, copy, fd, "checkpoints out of order");
+
+    /* a varint running off the end is only met upon lookup */
+    copy = sidecar;
+    copy[copy.size() - 1] |= 0x80;
+    writeFile(damaged, copy);
+
+    LineIndex truncatedVarint;
+
+    check(truncatedVarint.load(damaged.c_str(), fd), "load with a damaged varint");
+    check(-1 == truncatedVarint.offset(LINE_COUNT + 1), "offset past a damaged varint");
+    check(LINE_COUNT == truncatedVarint.lineAt(data.size()), "lineAt stops at a damaged varint");
+
+    /* what check-parenthesis does with a refused sidecar */
+    LineIndex rebuilt;
+
+    writeFile(damaged, sidecar.substr(0, HEADER_SIZE));
+    check(!rebuilt.load(damaged.c_str(), fd) && rebuilt.build(fd) &&
+          rebuilt.save(damaged.c_str()) && rebuilt.load(damaged.c_str(), fd) &&
+          offsets[LINE_COUNT] == rebuilt.offset(LINE_COUNT + 1),
+          "rebuild after a refused sidecar");
+
+    close(fd);
+    unlink(input.c_str());
+    unlink(path.c_str());
+    unlink(damaged.c_str());
+    rmdir(dir);
+
+    if (failures) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return RET_FAILURE;
+    }
+
+    std::cout << "OK" << std::endl;
+
+    return RET_OK;
+}
@@ -0,0 +1,168 @@
+/**
+ * ReadAhead test.
+ *
+ * Reads a generated file and a pipe through every backend and buffer
+ * count and checks the bytes come in order, then destroys a reader
+ * waiting on an idle pipe, which must not hang.
+ */
+#include "ReadAhead.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RET_OK                  0
+#define RET_FAILURE             1
+
+#define DATA_SIZE               (3 * 1000 * 1000 + 7)
+
+static unsigned failures = 0;
+
+static void check(bool condition, const std::string &what) {
+    if (!condition) {
+        std::cerr << "FAIL: " << what << std::endl;
+        ++failures;
+    }
+}
+
+/**
+ * Take every block, changing the read size on the way
+ */
+static std::string readAll(ReadAhead &readAhead) {
+    std::string data;
+    char *block;
+    size_t requested;
+    ssize_t readCount;
+
+    while ((readCount = readAhead.next(&block, &requested)) > 0) {
+        data.append(block, readCount);
+
+        if (1 == data.size() % 3) {
+            readAhead.readSize(std::min<size_t>(requested * 2 + 1, 1 << 20));
+        }
+    }
+
+    return readCount ? std::string("read failure: ") + strerror(errno) : data;
+}
+
+int main() {
+    char path[] = "/tmp/cqg-read-ahead.XXXXXX";
+    int fd = mkstemp(path);
+
+    if (fd < 0) {
+        std::cerr << "Can't create file: " << strerror(errno) << std::endl;
+        return RET_FAILURE;
+    }
+
+    std::string data;
+
+    for (size_t idx = 0; idx < DATA_SIZE; ++idx) {
+        data.push_back(static_cast<char>('a' + idx * 7 % 26));
+    }
+
+    if (write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size())) {
+        std::cerr << "Can't write " << path << ": " << strerror(errno) << std::endl;
+        return RET_FAILURE;
+    }
+
+    static const ReadAhead::Backend BACKENDS[] = {
+        ReadAhead::Backend::thread,
+        ReadAhead::Backend::io_uring,
+    };
+
+    if (!ReadAhead::supported(ReadAhead::Backend::io_uring)) {
+        std::cout << "io_uring is refused by the kernel, falling back checked only" << std::endl;
+    }
+
+    for (ReadAhead::Backend backend : BACKENDS) {
+        std::string name = ReadAhead::backendName(backend);
+
+        for (size_t buffers : { 1, 2, 3, 8 }) {
+            std::string what = name + " with " + std::to_string(buffers) + " buffers";
+
+            /* starts off the current position */
+            lseek(fd, 1000, SEEK_SET);
+
+            {
+                ReadAhead readAhead(fd, buffers, 4096, backend);
+
+                check(readAhead.backend() == backend ||
+                      !ReadAhead::supported(backend), what + ": backend");
+                check(readAhead.buffers() == buffers, what + ": buffers");
+                check(readAll(readAhead) == data.substr(1000), what + ": file");
+            }
+
+            int fds[2];
+
+            if (pipe(fds) < 0) {
+                check(false, what + ": pipe");
+                continue;
+            }
+
+            std::thread writer([&data, &fds]() {
+                /* small pieces so that reads come short */
+                for (size_t offset = 0; offset < data.size(); offset += 10000) {
+                    size_t size = std::min<size_t>(10000, data.size() - offset);
+
+                    if (write(fds[1], data.data() + offset, size) != static_cast<ssize_t>(size)) {
+                        break;
+                    }
+                }
+
+                close(fds[1]);
+            });
+
+            {
+                ReadAhead readAhead(fds[0], buffers, 4096, backend);
+
+                check(readAll(readAhead) == data, what + ": pipe");
+            }
+
+            writer.join();
+            close(fds[0]);
+
+            /* nothing ever comes, the read in flight is cancelled */
+            if (pipe(fds) < 0) {
+                check(false, what + ": pipe");
+                continue;
+            }
+
+            {
+                ReadAhead readAhead(fds[0], buffers, 4096, backend);
+                std::thread reader([&readAhead]() {
+                    char *block;
+                    size_t requested;
+
+                    readAhead.next(&block, &requested);
+                });
+
+                /* the data of the first block only */
+                check(1 == write(fds[1], "x", 1), what + ": idle pipe");
+                reader.join();
+            }
+
+            close(fds[0]);
+            close(fds[1]);
+        }
+    }
+
+    close(fd);
+    unlink(path);
+
+    if (failures) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return RET_FAILURE;
+    }
+
+    std::cout << "OK" << std::endl;
+
+    return RET_OK;
+}
@@ -0,0 +1,264 @@
+#include "async_callback.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+const unsigned AsyncCallback::SPIN_COUNT;
+const unsigned AsyncCallback::WAIT_MS;
+
+AsyncCallback::AsyncCallback(ICallback* callback, BackpressurePolicy policy, size_t capacity)
+: _callback(callback),
+  _policy(policy),
+  _producerSegment(new Segment(capacity ? capacity : 1)),
+  _consumerSegment(_producerSegment),
+  _recycled(_producerSegment->ring.capacity()),
+  _consumerWaiting(false),
+  _producerWaiting(false),
+  _stop(false),
+  _queued(0),
+  _taken(0),
+  _delivered(0),
+  _dropped(0),
+  _blocked(0),
+  _maxDepth(0),
+  _capacity(_producerSegment->ring.capacity()),
+  _recycledBytes(0)
+{
+    _worker = std::thread(&AsyncCallback::work, this);
+}
+
+AsyncCallback::~AsyncCallback()
+{
+    _stop.store(true, std::memory_order_release);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _queuedCv.notify_one();
+    }
+
+    _worker.join();
+
+    while (_consumerSegment) {
+        Segment *next = _consumerSegment->next.load(std::memory_order_acquire);
+
+        delete _consumerSegment;
+        _consumerSegment = next;
+    }
+}
+
+void AsyncCallback::BinaryPacket(const char* data, unsigned int size)
+{
+    enqueue(true, data, size);
+}
+
+void AsyncCallback::TextPacket(const char* data, unsigned int size)
+{
+    enqueue(false, data, size);
+}
+
+AsyncCallback::Stats AsyncCallback::stats() const
+{
+    uint64_t taken = _taken.load(std::memory_order_acquire);
+    uint64_t queued = _queued.load(std::memory_order_acquire);
+
+    return Stats{
+        queued > taken ? static_cast<size_t>(queued - taken) : 0,
+        _maxDepth.load(std::memory_order_relaxed),
+        _capacity.load(std::memory_order_relaxed),
+        queued,
+        _delivered.load(std::memory_order_acquire),
+        _dropped.load(std::memory_order_relaxed),
+        _blocked.load(std::memory_order_relaxed),
+        _recycledBytes.load(std::memory_order_relaxed)
+    };
+}
+
+void AsyncCallback::Drain()
+{
+    uint64_t queued = _queued.load(std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (_delivered.load(std::memory_order_acquire) < queued) {
+        _producerWaiting.store(true);
+        _spaceCv.wait_for(lock, std::chrono::milliseconds(WAIT_MS));
+    }
+
+    _producerWaiting.store(false);
+}
+
+/*** receiving thread ***/
+void AsyncCallback::enqueue(bool binary, const char *data, unsigned int size)
+{
+    Packet packet;
+
+    packet.binary = binary;
+
+    if (_recycled.pop(packet.data)) {
+        _recycledBytes.fetch_sub(packet.data.capacity(), std::memory_order_relaxed);
+    }
+
+    packet.data.append(data, size);
+
+    if (!_producerSegment->ring.push(std::move(packet))) {
+        switch (_policy) {
+        case BP_BLOCK:
+            waitForSpace(packet);
+            break;
+        case BP_DROP_NEWEST:
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        case BP_GROW:
+            grow(packet);
+            break;
+        }
+    }
+
+    uint64_t queued = _queued.fetch_add(1, std::memory_order_release) + 1;
+    size_t depth = queued - _taken.load(std::memory_order_acquire);
+
+    /* _taken lags behind the slot freed by the pop, a single ring can't */
+    if (BP_GROW != _policy) {
+        depth = std::min(depth, _producerSegment->ring.size());
+    }
+
+    if (depth > _maxDepth.load(std::memory_order_relaxed)) {
+        _maxDepth.store(depth, std::memory_order_relaxed);
+    }
+
+    /* pairs with the fence of the callback thread going to sleep */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (_consumerWaiting.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _queuedCv.notify_one();
+    }
+}
+
+void AsyncCallback::waitForSpace(Packet &packet)
+{
+    _blocked.fetch_add(1, std::memory_order_relaxed);
+
+    for (unsigned spin = 0; !_producerSegment->ring.push(std::move(packet)); ++spin) {
+        if (spin < SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _producerWaiting.store(true);
+        _spaceCv.wait_for(lock, std::chrono::milliseconds(WAIT_MS));
+        _producerWaiting.store(false);
+    }
+}
+
+void AsyncCallback::grow(Packet &packet)
+{
+    Segment *segment = new Segment(2 * _producerSegment->ring.capacity());
+
+    segment->ring.push(std::move(packet));
+
+    /* the older ring is never touched by this thread from now on */
+    _producerSegment->next.store(segment, std::memory_order_release);
+    _producerSegment = segment;
+    _capacity.store(segment->ring.capacity(), std::memory_order_relaxed);
+}
+
+/*** callback thread ***/
+bool AsyncCallback::dequeue(Packet &packet)
+{
+    while (true) {
+        if (_consumerSegment->ring.pop(packet)) {
+            return true;
+        }
+
+        Segment *next = _consumerSegment->next.load(std::memory_order_acquire);
+
+        if (!next) {
+            return false;
+        }
+
+        /* the older ring might have got more packets before the link */
+        if (_consumerSegment->ring.pop(packet)) {
+            return true;
+        }
+
+        delete _consumerSegment;
+        _consumerSegment = next;
+    }
+}
+
+void AsyncCallback::recycle(Buffer &buffer)
+{
+    size_t capacity = buffer.capacity();
+
+    /* one burst of large packets must not stay around for good */
+    if (!capacity || capacity > BufferPool::MAX_CAPACITY) {
+        buffer = Buffer();
+        return;
+    }
+
+    buffer.clear();
+
+    /* counted before the push, the receiving thread subtracts it upon pop */
+    _recycledBytes.fetch_add(capacity, std::memory_order_relaxed);
+
+    if (!_recycled.push(std::move(buffer))) {
+        _recycledBytes.fetch_sub(capacity, std::memory_order_relaxed);
+        buffer = Buffer();
+    }
+}
+
+void AsyncCallback::work()
+{
+    Packet packet;
+
+    while (true) {
+        bool stopping = _stop.load(std::memory_order_acquire);
+
+        if (dequeue(packet)) {
+            _taken.fetch_add(1, std::memory_order_release);
+
+            const char *data = packet.data.capacity() ? packet.data.data() : "";
+
+            if (packet.binary) {
+                _callback->BinaryPacket(data, packet.data.size());
+            } else {
+                _callback->TextPacket(data, packet.data.size());
+            }
+
+            _delivered.fetch_add(1, std::memory_order_release);
+
+            recycle(packet.data);
+
+            if (_producerWaiting.load()) {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                _spaceCv.notify_one();
+            }
+
+            continue;
+        }
+
+        if (stopping) {
+            // everything queued before destruction is delivered
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _consumerWaiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (_consumerSegment->ring.empty() &&
+            !_consumerSegment->next.load(std::memory_order_acquire) &&
+            !_stop.load(std::memory_order_acquire)) {
+            _queuedCv.wait_for(lock, std::chrono::milliseconds(WAIT_MS));
+        }
+
+        _consumerWaiting.store(false, std::memory_order_relaxed);
+    }
+}
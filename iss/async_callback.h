@@ -0,0 +1,143 @@
+#ifndef ISS_ASYNC_CALLBACK_H
+#define ISS_ASYNC_CALLBACK_H 1
+
+#include "iface.h"
+#include "buffer.h"
+#include "spsc_ring.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/**
+ * Decouples slow callbacks from the receiving thread.
+ *
+ * Passed to a Receiver instead of the callback itself. Every packet
+ * is copied into an owned buffer and put into a lock-free SPSC ring,
+ * a dedicated thread takes packets from the ring and calls the wrapped
+ * callback in the order of arrival. Buffers go back to the receiving
+ * thread through another ring to be reused, those larger than
+ * BufferPool::MAX_CAPACITY are freed instead.
+ *
+ * Only one thread may deliver packets to it, i.e. it serves
+ * a single Receiver.
+ */
+struct AsyncCallback : public ICallback {
+    enum BackpressurePolicy {
+        BP_BLOCK        = 0,        // wait for the callback thread
+        BP_DROP_NEWEST,             // drop the packet being delivered
+        BP_GROW,                    // chain a twice larger ring
+    };
+
+    struct Stats {
+        size_t depth;               // packets in the rings now
+        size_t maxDepth;            // the most packets ever in the rings,
+                                    // the one being delivered is not counted
+        size_t capacity;            // of the ring being filled
+        uint64_t queued;
+        uint64_t delivered;
+        uint64_t dropped;
+        uint64_t blocked;           // times the receiving thread waited
+        size_t recycledBytes;       // capacity of the buffers kept for reuse
+    };
+
+    static const size_t DEFAULT_CAPACITY = 1024;
+
+private:
+    /************************ types ************************/
+    struct Packet {
+        bool binary;
+        Buffer data;
+    };
+
+    /* the rings are chained when growing, the consumer
+     * drains the older one before switching to the next */
+    struct Segment {
+        SpscRing<Packet> ring;
+        std::atomic<Segment *> next;
+
+        explicit Segment(size_t capacity)
+        : ring(capacity),
+          next(nullptr)
+        {
+        }
+    };
+
+    /************************ data ************************/
+    static const unsigned SPIN_COUNT = 64;
+    static const unsigned WAIT_MS = 1;      // safety net for missed wakeups
+
+    ICallback* _callback;
+    BackpressurePolicy _policy;
+
+    Segment *_producerSegment;
+    Segment *_consumerSegment;
+    SpscRing<Buffer> _recycled;     // consumer to producer
+
+    std::thread _worker;
+    std::mutex _mutex;
+    std::condition_variable _queuedCv;
+    std::condition_variable _spaceCv;
+    std::atomic<bool> _consumerWaiting;
+    std::atomic<bool> _producerWaiting;
+    std::atomic<bool> _stop;
+
+    std::atomic<uint64_t> _queued;
+    std::atomic<uint64_t> _taken;   // out of the rings
+    std::atomic<uint64_t> _delivered;
+    std::atomic<uint64_t> _dropped;
+    std::atomic<uint64_t> _blocked;
+    std::atomic<size_t> _maxDepth;
+    std::atomic<size_t> _capacity;
+    std::atomic<size_t> _recycledBytes;
+
+    /************************ methods ************************/
+    void enqueue(bool binary, const char *data, unsigned int size);
+    /**
+     * Wait until the ring being filled has room
+     */
+    void waitForSpace(Packet &packet);
+    void grow(Packet &packet);
+
+    /**
+     * \return \c false if nothing is queued
+     */
+    bool dequeue(Packet &packet);
+    /**
+     * Give a delivered buffer back to the receiving thread or free it
+     */
+    void recycle(Buffer &buffer);
+    void work();
+
+public:
+    /**
+     * \param callback called on the dedicated thread
+     * \param capacity packets the ring holds, the initial one for BP_GROW
+     */
+    AsyncCallback(ICallback* callback,
+                  BackpressurePolicy policy = BP_BLOCK,
+                  size_t capacity = DEFAULT_CAPACITY);
+    /**
+     * Delivers everything queued before returning
+     */
+    ~AsyncCallback();
+
+    AsyncCallback(const AsyncCallback &) = delete;
+    AsyncCallback &operator=(const AsyncCallback &) = delete;
+
+    void BinaryPacket(const char* data, unsigned int size) override;
+    void TextPacket(const char* data, unsigned int size) override;
+
+    /**
+     * Wait until everything queued so far is delivered,
+     * called on the receiving thread
+     */
+    void Drain();
+
+    Stats stats() const;
+};
+
+#endif  /* ISS_ASYNC_CALLBACK_H */
@@ -0,0 +1,1499 @@
+/**
+ * Throughput benchmark and fuzz-replay harness for Receiver.
+ *
+ * Benchmark mode pre-generates a corpus of packets in memory for every
+ * size distribution and text/binary mix, feeds it to Receiver in fixed
+ * chunks, random splits or batches and reports Gbit/s, packets/s, peak
+ * RSS and heap allocations as CSV for comparison between commits.
+ *
+ * Fuzz mode generates hostile corpora (bytes of the terminator and of
+ * the binary start marker everywhere), splits them at random and checks
+ * that exactly the generated packets are delivered, in order, with both
+ * ICallback and IStreamCallback, for the task framing and two sibling
+ * ones. Some rounds deliver through AsyncCallback with a tiny ring and
+ * a slow callback to check ordering, drop counts and Drain of every
+ * backpressure policy, \c -A forces one. Everything is derived from
+ * the round seed so that a failing round is replayed with \c -R.
+ *
+ * Loopback mode replays the corpus over TCP or UNIX socket connections
+ * to SocketFrontend and checks the packets delivered on each of them.
+ * Two more connections fail, one in its callback and one in StreamOpened,
+ * to check that they cost no other connection.
+ *
+ * Pool mode interleaves the chunks of many streams, each with its own
+ * corpus, through ReceiverPool and checks the packets of every stream
+ * are delivered in order. One more stream has a throwing callback to
+ * check that it costs no other stream.
+ *
+ * Receivers of the benchmark and loopback modes may be given a memory
+ * budget with \c -M to see the resident memory of spilling packets.
+ */
+#include "async_callback.h"
+#include "iface.h"
+#include "receiver.h"
+#include "receiver_pool.h"
+#include "socket_frontend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RET_OK                  0
+#define RET_FAILURE             1
+#define RET_INVALID_ARGS        3
+
+#define GBIT                    (1000. * 1000. * 1000. / 8.)
+
+/*** heap allocations made by the code under test ***/
+static std::atomic<size_t> allocations(0);
+
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    ++allocations;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    ++allocations;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    ++allocations;
+    return __libc_realloc(ptr, size);
+}
+
+}   /* extern "C" */
+
+/*** framings ***/
+/* siblings of the task protocol covering the rest of Framing */
+typedef Framing<'#', 2, true, '\n'> LineFraming;
+typedef Framing<'\x02', 3, false, '\x03', '\x03', '\x04'> EtxFraming;
+
+/**
+ * Framing parameters for the corpus generator
+ */
+struct Wire {
+    const char  *name;
+    char        start;
+    size_t      lengthSize;
+    bool        bigEndian;
+    std::string finish;
+};
+
+template <class Protocol>
+static Wire wire(const char *name) {
+    return Wire{name, Protocol::BINARY_PKT_START, Protocol::LENGTH_SIZE,
+                Protocol::LENGTH_BIG_ENDIAN,
+                std::string(Protocol::TEXT_PKT_FINISH, Protocol::TEXT_PKT_FINISH_LEN)};
+}
+
+/*** corpus ***/
+enum Mix {
+    MIX_TEXT    = 0,
+    MIX_BINARY,
+    MIX_MIXED,
+
+    _MIX_COUNT
+};
+
+static const char *MIX_NAMES[_MIX_COUNT] = { "text", "binary", "mixed" };
+
+enum Split {
+    SPLIT_CHUNK = 0,                    // fixed size chunks
+    SPLIT_RANDOM,                       // random sizes, the same size on average
+    SPLIT_BATCH,                        // fixed size chunks passed in batches
+
+    _SPLIT_COUNT
+};
+
+static const char *SPLIT_NAMES[_SPLIT_COUNT] = { "chunk", "random", "batch" };
+
+struct Distribution {
+    const char  *name;
+    size_t      minSize;
+    size_t      maxSize;
+};
+
+static const Distribution DISTRIBUTIONS[] = {
+    { "fixed-0",        0,          0           },
+    { "fixed-8",        8,          8           },
+    { "fixed-32",       32,         32          },
+    { "fixed-128",      128,        128         },
+    { "fixed-512",      512,        512         },
+    { "task",           1,          8192        },
+    { "large",          64 << 10,   1 << 20     },
+};
+
+static const size_t BATCH_CHUNKS = 64;
+
+struct Packet {
+    bool        text;
+    size_t      offset;                 // of the data in the corpus
+    size_t      size;
+};
+
+struct Corpus {
+    std::string data;
+    std::vector<Packet> packets;
+};
+
+struct Options {
+    size_t      size        = 64 << 20;
+    size_t      chunk       = 1024;
+    unsigned    repeat      = 3;
+    unsigned    seed        = 1;
+    const char  *tag        = "current";
+    Distribution custom     = { "custom", 0, 0 };
+    bool        hasCustom   = false;
+    int         mix         = -1;       // all of them
+    unsigned    fuzzRounds  = 0;
+    int         asyncPolicy = -1;       // drawn by the round
+    bool        replay      = false;
+    const char  *loopback   = nullptr;  // tcp or unix
+    unsigned    connections = 4;
+    unsigned    poolStreams = 0;
+    size_t      shards      = 0;        // the number of CPUs
+    size_t      budget      = SIZE_MAX; // per receiver
+    size_t      sharedBudget = SIZE_MAX;    // none if unlimited
+};
+
+struct Result {
+    size_t      bytes       = 0;
+    size_t      packets     = 0;
+    double      seconds     = 0.;
+    long        peakRssKb   = 0;
+    long        rssGrowthKb = 0;
+    size_t      allocations = 0;
+};
+
+static double now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t uniform(unsigned *state, size_t min, size_t max) {
+    if (max <= min) {
+        return min;
+    }
+
+    /* rand_r yields 31 bits only */
+    size_t value = (static_cast<size_t>(rand_r(state)) << 31) | rand_r(state);
+
+    return min + value % (max - min + 1);
+}
+
+/**
+ * Make text packet data deliverable as is: no terminator inside,
+ * no terminator formed with the trailing one, no binary start marker
+ */
+static void sanitizeText(const Wire &wire, std::string &data) {
+    const std::string &finish = wire.finish;
+
+    for (size_t idx = finish.size() - 1; idx < data.size(); ++idx) {
+        if (!data.compare(idx + 1 - finish.size(), finish.size(), finish)) {
+            data[idx] = 'x';
+        }
+    }
+
+    while (true) {
+        std::string full = data + finish;
+
+        if (full.find(finish) == data.size()) {
+            break;
+        }
+
+        data.back() = 'y';
+    }
+
+    if (!data.empty() && wire.start == data[0]) {
+        data[0] = 'b';
+    }
+}
+
+/**
+ * Generate packets up to \c size bytes total
+ * \param hostile draw bytes from the terminator and the binary start marker
+ */
+static Corpus generate(const Wire &wire, Mix mix, const Distribution &dist, size_t size,
+                       unsigned seed, bool hostile) {
+    const std::string hostileBytes = wire.finish + wire.start + "ab";
+    const size_t maxLength = wire.lengthSize < sizeof(uint32_t) ?
+                             (size_t(1) << 8 * wire.lengthSize) - 1 : UINT32_MAX;
+
+    Corpus corpus;
+    unsigned state = seed;
+    std::string data;
+
+    while (corpus.data.size() < size) {
+        bool text = MIX_TEXT == mix || (MIX_MIXED == mix && (rand_r(&state) & 1));
+        size_t packetSize = uniform(&state, dist.minSize, dist.maxSize);
+
+        data.resize(text ? packetSize : std::min(packetSize, maxLength));
+
+        for (char &c : data) {
+            c = hostile ? hostileBytes[rand_r(&state) % hostileBytes.size()] :
+                text    ? 'a' + rand_r(&state) % 26 :
+                          rand_r(&state);
+        }
+
+        if (text) {
+            if (hostile) {
+                sanitizeText(wire, data);
+            }
+
+            corpus.packets.push_back(Packet{true, corpus.data.size(), data.size()});
+            corpus.data.append(data);
+            corpus.data.append(wire.finish);
+        } else {
+            corpus.data.push_back(wire.start);
+
+            for (size_t idx = 0; idx < wire.lengthSize; ++idx) {
+                size_t shift = 8 * (wire.bigEndian ? wire.lengthSize - 1 - idx : idx);
+
+                corpus.data.push_back(static_cast<char>(data.size() >> shift));
+            }
+
+            corpus.packets.push_back(Packet{false, corpus.data.size(), data.size()});
+            corpus.data.append(data);
+        }
+    }
+
+    return corpus;
+}
+
+/**
+ * Cut the corpus into chunks
+ * \param chunk chunk size or average size for random splits
+ */
+static std::vector<struct iovec> slice(const Corpus &corpus, Split split,
+                                       size_t chunk, unsigned seed) {
+    std::vector<struct iovec> chunks;
+    unsigned state = seed;
+    const char *p = corpus.data.data();
+    const char *end = p + corpus.data.size();
+
+    while (p < end) {
+        struct iovec iov;
+        size_t size = SPLIT_RANDOM == split ? uniform(&state, 1, 2 * chunk - 1) : chunk;
+
+        iov.iov_base = const_cast<char *>(p);
+        iov.iov_len = std::min<size_t>(size, end - p);
+        chunks.push_back(iov);
+        p += iov.iov_len;
+    }
+
+    return chunks;
+}
+
+/*** callbacks ***/
+struct CountingCallback : public ICallback {
+    size_t packets;
+    uint8_t sum;
+
+    CountingCallback()
+    : packets(0), sum(0)
+    {
+    }
+
+    void BinaryPacket(const char *data, unsigned int size) override {
+        ++packets;
+        sum ^= size ? data[0] : 0;
+    }
+
+    void TextPacket(const char *data, unsigned int size) override {
+        ++packets;
+        sum ^= size ? data[0] : 0;
+    }
+};
+
+/**
+ * Compares delivered packets with the corpus ones,
+ * streamed packets are assembled before the comparison
+ */
+struct VerifyingCallback : public IStreamCallback {
+    const Corpus &corpus;
+    size_t packets;                     // corpus packets checked
+    std::string failure;                // the first one
+
+    bool lossy;                         // packets may be missing but not reordered
+    size_t skipped;                     // missing ones
+
+    bool streaming;
+    bool streamedBinary;
+    unsigned int streamedSize;
+    std::string streamed;
+
+    VerifyingCallback(const Corpus &c, bool l = false)
+    : corpus(c), packets(0), lossy(l), skipped(0),
+      streaming(false), streamedBinary(false), streamedSize(0)
+    {
+    }
+
+    size_t delivered() const {
+        return packets - skipped;
+    }
+
+    bool matches(const Packet &expected, bool text, const char *data, size_t size) const {
+        return expected.text == text && expected.size == size &&
+               (!size || !memcmp(corpus.data.data() + expected.offset, data, size));
+    }
+
+    void fail(const std::string &what) {
+        if (failure.empty()) {
+            failure = "packet " + std::to_string(packets) + ": " + what;
+        }
+    }
+
+    void check(bool text, const char *data, size_t size) {
+        while (lossy && packets < corpus.packets.size() &&
+               !matches(corpus.packets[packets], text, data, size)) {
+            ++packets;
+            ++skipped;
+        }
+
+        if (packets >= corpus.packets.size()) {
+            fail("superfluous packet");
+            return;
+        }
+
+        const Packet &expected = corpus.packets[packets];
+
+        if (expected.text != text) {
+            fail(text ? "text instead of binary" : "binary instead of text");
+        } else if (expected.size != size) {
+            fail("size " + std::to_string(size) +
+                 " instead of " + std::to_string(expected.size));
+        } else if (size && memcmp(corpus.data.data() + expected.offset, data, size)) {
+            fail("data differs");
+        }
+
+        ++packets;
+    }
+
+    void BinaryPacket(const char *data, unsigned int size) override {
+        if (streaming) {
+            fail("whole packet while streaming");
+        }
+
+        check(false, data, size);
+    }
+
+    void TextPacket(const char *data, unsigned int size) override {
+        if (streaming) {
+            fail("whole packet while streaming");
+        }
+
+        check(true, data, size);
+    }
+
+    void PacketBegin(bool binary, unsigned int size) override {
+        if (streaming) {
+            fail("nested stream");
+        }
+
+        streaming = true;
+        streamedBinary = binary;
+        streamedSize = size;
+        streamed.clear();
+    }
+
+    void PacketFragment(const char *data, unsigned int size) override {
+        if (!streaming || !size) {
+            fail("unexpected fragment");
+        }
+
+        streamed.append(data, size);
+    }
+
+    void PacketEnd() override {
+        if (!streaming) {
+            fail("unexpected end");
+        }
+
+        if (streamedBinary && streamed.size() != streamedSize) {
+            fail("streamed size differs from the announced one");
+        }
+
+        streaming = false;
+        check(!streamedBinary, streamed.data(), streamed.size());
+    }
+};
+
+/**
+ * Forwards packets pausing now and then so that queues fill up
+ */
+struct DelayingCallback : public ICallback {
+    ICallback *callback;
+    unsigned every;                     // packets between pauses, never if nil
+    size_t count;
+
+    DelayingCallback(ICallback *cb, unsigned e)
+    : callback(cb), every(e), count(0)
+    {
+    }
+
+    void pause() {
+        if (every && !(++count % every)) {
+            usleep(20);
+        }
+    }
+
+    void BinaryPacket(const char *data, unsigned int size) override {
+        pause();
+        callback->BinaryPacket(data, size);
+    }
+
+    void TextPacket(const char *data, unsigned int size) override {
+        pause();
+        callback->TextPacket(data, size);
+    }
+};
+
+/*** measurements ***/
+/**
+ * Reset peak RSS of the process to the current RSS
+ */
+static void resetPeakRss() {
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+
+    if (f) {
+        fputs("5", f);
+        fclose(f);
+    }
+}
+
+/**
+ * \return \c VmHWM or \c VmRSS from /proc/self/status in KiB,
+ *         \c ru_maxrss if there's no procfs
+ */
+static long statusKb(const char *field) {
+    FILE *f = fopen("/proc/self/status", "r");
+    char line[256];
+    long value = -1;
+    size_t fieldLen = strlen(field);
+
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            if (!strncmp(line, field, fieldLen) && ':' == line[fieldLen]) {
+                value = strtol(line + fieldLen + 1, NULL, 10);
+                break;
+            }
+        }
+
+        fclose(f);
+    }
+
+    if (value < 0) {
+        struct rusage usage;
+
+        getrusage(RUSAGE_SELF, &usage);
+        value = usage.ru_maxrss;
+    }
+
+    return value;
+}
+
+/**
+ * Time, peak RSS and allocations from construction up to \c finish
+ */
+struct Measurement {
+    long rss;
+    size_t allocated;
+    double start;
+
+    Measurement() {
+        resetPeakRss();
+        rss = statusKb("VmRSS");
+        allocated = allocations;
+        start = now();
+    }
+
+    void finish(Result &result) const {
+        result.seconds = now() - start;
+        result.allocations = allocations - allocated;
+        result.peakRssKb = statusKb("VmHWM");
+        result.rssGrowthKb = result.peakRssKb - rss;
+    }
+};
+
+template <class Rcv, class Callback>
+static Result feed(Rcv &rcv, Callback &cb, const Corpus &corpus,
+                   const std::vector<struct iovec> &chunks, bool batch) {
+    Result result;
+    Measurement measurement;
+
+    if (batch) {
+        for (size_t idx = 0; idx < chunks.size(); idx += BATCH_CHUNKS) {
+            rcv.ReceiveBatch(chunks.data() + idx, std::min(BATCH_CHUNKS, chunks.size() - idx));
+        }
+    } else {
+        for (const struct iovec &chunk : chunks) {
+            rcv.Receive(reinterpret_cast<const char *>(chunk.iov_base), chunk.iov_len);
+        }
+    }
+
+    measurement.finish(result);
+    result.bytes = corpus.data.size();
+    result.packets = cb.packets;
+
+    return result;
+}
+
+static Result bench(const Options &options, const Corpus &corpus,
+                    const std::vector<struct iovec> &chunks, bool batch) {
+    CountingCallback cb;
+    Receiver rcv(&cb);
+    MemoryBudget shared(options.sharedBudget);
+
+    rcv.SetMemoryBudget(options.budget, SIZE_MAX == options.sharedBudget ? nullptr : &shared);
+
+    return feed(rcv, cb, corpus, chunks, batch);
+}
+
+/**
+ * Run \c bench \c repeat times and keep the best one
+ */
+template <class Bench>
+static Result best(unsigned repeat, Bench bench) {
+    Result bestResult;
+
+    for (unsigned idx = 0; idx < repeat; ++idx) {
+        Result result = bench();
+
+        if (!idx || result.seconds < bestResult.seconds) {
+            bestResult = result;
+        }
+    }
+
+    return bestResult;
+}
+
+static void reportHeader() {
+    std::cout << "tag,distribution,mix,split,bytes,packets,seconds,gbit_per_s,packets_per_s,"
+                 "peak_rss_kb,rss_growth_kb,allocations"
+              << std::endl;
+}
+
+static void report(const Options &options, const Distribution &dist, Mix mix,
+                   const char *split, const Result &result) {
+    double seconds = result.seconds > 0. ? result.seconds : 1e-9;
+
+    std::cout << options.tag << ','
+              << dist.name << ','
+              << MIX_NAMES[mix] << ','
+              << split << ','
+              << result.bytes << ','
+              << result.packets << ','
+              << result.seconds << ','
+              << result.bytes / GBIT / seconds << ','
+              << result.packets / seconds << ','
+              << result.peakRssKb << ','
+              << result.rssGrowthKb << ','
+              << result.allocations
+              << std::endl;
+}
+
+static int runBenchmarks(const Options &options) {
+    std::vector<Distribution> distributions;
+
+    if (options.hasCustom) {
+        distributions.push_back(options.custom);
+    } else {
+        distributions.assign(std::begin(DISTRIBUTIONS), std::end(DISTRIBUTIONS));
+    }
+
+    reportHeader();
+
+    for (const Distribution &dist : distributions) {
+        for (int mix = 0; mix < _MIX_COUNT; ++mix) {
+            if (options.mix >= 0 && options.mix != mix) {
+                continue;
+            }
+
+            Corpus corpus = generate(wire<IssFraming>("iss"), static_cast<Mix>(mix), dist,
+                                     options.size, options.seed, false);
+
+            for (int split = 0; split < _SPLIT_COUNT; ++split) {
+                std::vector<struct iovec> chunks = slice(corpus, static_cast<Split>(split),
+                                                         options.chunk, options.seed);
+                Result result = best(options.repeat, [&]() {
+                    return bench(options, corpus, chunks, SPLIT_BATCH == split);
+                });
+
+                /* figures of a broken parser are worthless */
+                if (result.packets != corpus.packets.size()) {
+                    std::cerr << "Packets lost: " << dist.name << ' ' << MIX_NAMES[mix]
+                              << ' ' << SPLIT_NAMES[split] << std::endl;
+                    return RET_FAILURE;
+                }
+
+                report(options, dist, static_cast<Mix>(mix), SPLIT_NAMES[split], result);
+            }
+        }
+    }
+
+    return RET_OK;
+}
+
+/*** fuzzing ***/
+template <class Protocol>
+static void fuzzFeed(VerifyingCallback &cb, const Corpus &corpus,
+                     const std::vector<struct iovec> &chunks, bool batch,
+                     bool streaming, size_t threshold,
+                     size_t budget, MemoryBudget *shared) {
+    if (streaming) {
+        BasicReceiver<Protocol> rcv(&cb, threshold);
+
+        rcv.SetMemoryBudget(budget, shared);
+        feed(rcv, cb, corpus, chunks, batch);
+    } else {
+        BasicReceiver<Protocol> rcv(static_cast<ICallback *>(&cb));
+
+        rcv.SetMemoryBudget(budget, shared);
+        feed(rcv, cb, corpus, chunks, batch);
+    }
+}
+
+static const char *POLICY_NAMES[] = { "block", "drop", "grow" };
+
+/**
+ * Deliver through AsyncCallback and check its stats once drained
+ */
+template <class Protocol>
+static void fuzzFeedAsync(VerifyingCallback &cb, const Corpus &corpus,
+                          const std::vector<struct iovec> &chunks, bool batch,
+                          size_t budget, MemoryBudget *shared,
+                          AsyncCallback::BackpressurePolicy policy, size_t capacity,
+                          unsigned delayEvery) {
+    DelayingCallback slow(&cb, delayEvery);
+    AsyncCallback async(&slow, policy, capacity);
+    AsyncCallback::Stats stats;
+
+    {
+        BasicReceiver<Protocol> rcv(&async);
+        /* the verifying one belongs to the callback thread */
+        CountingCallback unused;
+
+        rcv.SetMemoryBudget(budget, shared);
+        feed(rcv, unused, corpus, chunks, batch);
+    }
+
+    async.Drain();
+    stats = async.stats();
+
+    /* nothing is delivered past Drain, the callback thread is idle */
+    if (!cb.failure.empty()) {
+        return;
+    }
+
+    size_t dropped = corpus.packets.size() - cb.delivered();
+
+    if (stats.delivered != cb.delivered() || stats.queued != stats.delivered || stats.depth) {
+        cb.failure = "not drained: " + std::to_string(stats.queued) + " queued, " +
+                     std::to_string(stats.delivered) + " delivered, " +
+                     std::to_string(cb.delivered()) + " seen, depth " +
+                     std::to_string(stats.depth);
+    } else if (stats.dropped != dropped ||
+               (AsyncCallback::BP_DROP_NEWEST != policy && dropped)) {
+        cb.failure = std::to_string(dropped) + " packets missing, " +
+                     std::to_string(stats.dropped) + " dropped";
+    } else if (AsyncCallback::BP_GROW != policy && stats.maxDepth > stats.capacity) {
+        cb.failure = "depth " + std::to_string(stats.maxDepth) + " of " +
+                     std::to_string(stats.capacity) + " ring";
+    } else if (AsyncCallback::BP_GROW == policy && stats.capacity < capacity) {
+        cb.failure = "ring shrunk to " + std::to_string(stats.capacity);
+    }
+
+    if (!cb.failure.empty()) {
+        return;
+    }
+
+    /* a burst of packets too large to keep must not stay in the recycled buffers */
+    static const std::string large(BufferPool::MAX_CAPACITY + 1, 'x');
+    CountingCallback sink;
+
+    slow.callback = &sink;
+
+    for (unsigned packet = 0; packet < 4; ++packet) {
+        async.BinaryPacket(large.data(), large.size());
+    }
+
+    async.Drain();
+
+    if (async.stats().recycledBytes > stats.recycledBytes) {
+        cb.failure = "recycled buffers grew from " + std::to_string(stats.recycledBytes) +
+                     " to " + std::to_string(async.stats().recycledBytes) +
+                     " bytes after large packets";
+    }
+}
+
+/**
+ * Run a single fuzz round, everything is derived from \c seed
+ * \param asyncPolicy deliver through AsyncCallback with this policy,
+ *                    drawn by the round if negative
+ * \return \c false if the packets delivered differ from the generated ones
+ */
+static bool fuzzRound(unsigned seed, bool verbose, int asyncPolicy) {
+    static const Distribution FUZZ_DISTRIBUTIONS[] = {
+        { "tiny",       0,      16      },
+        { "small",      0,      512     },
+        { "medium",     0,      8192    },
+    };
+    static const size_t FUZZ_CHUNKS[] = { 1, 2, 3, 7, 1024, 4096 };
+    static const Wire WIRES[] = {
+        wire<IssFraming>("iss"),
+        wire<LineFraming>("line"),
+        wire<EtxFraming>("etx"),
+    };
+
+    unsigned state = seed;
+    size_t wireIdx = rand_r(&state) % (sizeof(WIRES) / sizeof(WIRES[0]));
+    const Wire &wire = WIRES[wireIdx];
+    const Distribution &dist = FUZZ_DISTRIBUTIONS[rand_r(&state) %
+                                   (sizeof(FUZZ_DISTRIBUTIONS) / sizeof(FUZZ_DISTRIBUTIONS[0]))];
+    Mix mix = static_cast<Mix>(rand_r(&state) % _MIX_COUNT);
+    Split split = static_cast<Split>(rand_r(&state) % _SPLIT_COUNT);
+    size_t chunk = FUZZ_CHUNKS[rand_r(&state) % (sizeof(FUZZ_CHUNKS) / sizeof(FUZZ_CHUNKS[0]))];
+    size_t size = uniform(&state, 0, 256 << 10);
+    bool streaming = rand_r(&state) & 1;
+    size_t threshold = uniform(&state, 0, 1024);
+    bool budgeted = rand_r(&state) & 1;
+    size_t budget = budgeted ? uniform(&state, 0, 2048) : SIZE_MAX;
+    MemoryBudget shared(uniform(&state, 0, 4096));
+
+    Corpus corpus = generate(wire, mix, dist, size, rand_r(&state), true);
+    std::vector<struct iovec> chunks = slice(corpus, split, chunk, rand_r(&state));
+    bool batch = SPLIT_BATCH == split;
+
+    MemoryBudget *sharedBudget = budgeted && (rand_r(&state) & 1) ? &shared : nullptr;
+
+    /* drawn last so that the rounds of the seeds above stay the same */
+    bool async = rand_r(&state) % 3 == 0;
+    AsyncCallback::BackpressurePolicy policy =
+        static_cast<AsyncCallback::BackpressurePolicy>(rand_r(&state) % 3);
+    size_t capacity = uniform(&state, 1, 16);
+    unsigned delayEvery = uniform(&state, 0, 64);
+
+    if (asyncPolicy >= 0) {
+        async = true;
+        policy = static_cast<AsyncCallback::BackpressurePolicy>(asyncPolicy);
+    }
+
+    /* AsyncCallback delivers whole packets only */
+    streaming = streaming && !async;
+
+    VerifyingCallback cb(corpus, async && AsyncCallback::BP_DROP_NEWEST == policy);
+
+    switch (wireIdx) {
+    case 0:
+        if (async) {
+            fuzzFeedAsync<IssFraming>(cb, corpus, chunks, batch, budget, sharedBudget,
+                                      policy, capacity, delayEvery);
+        } else {
+            fuzzFeed<IssFraming>(cb, corpus, chunks, batch, streaming, threshold,
+                                 budget, sharedBudget);
+        }
+        break;
+    case 1:
+        if (async) {
+            fuzzFeedAsync<LineFraming>(cb, corpus, chunks, batch, budget, sharedBudget,
+                                       policy, capacity, delayEvery);
+        } else {
+            fuzzFeed<LineFraming>(cb, corpus, chunks, batch, streaming, threshold,
+                                  budget, sharedBudget);
+        }
+        break;
+    case 2:
+        if (async) {
+            fuzzFeedAsync<EtxFraming>(cb, corpus, chunks, batch, budget, sharedBudget,
+                                      policy, capacity, delayEvery);
+        } else {
+            fuzzFeed<EtxFraming>(cb, corpus, chunks, batch, streaming, threshold,
+                                 budget, sharedBudget);
+        }
+        break;
+    }
+
+    if (cb.failure.empty() && shared.used()) {
+        cb.failure = std::to_string(shared.used()) + " bytes of the shared budget leaked";
+    }
+
+    /* the drop count is checked against the AsyncCallback stats */
+    if (cb.failure.empty() && !cb.lossy && cb.packets != corpus.packets.size()) {
+        cb.failure = std::to_string(corpus.packets.size() - cb.packets) + " packets lost";
+    }
+
+    if (verbose || !cb.failure.empty()) {
+        std::cout << "seed " << seed << ": "
+                  << wire.name << ' ' << dist.name << ' ' << MIX_NAMES[mix] << ' ' << SPLIT_NAMES[split]
+                  << " chunk " << chunk << ", " << corpus.packets.size() << " packets, "
+                  << corpus.data.size() << " bytes";
+
+        if (streaming) {
+            std::cout << ", streaming above " << threshold;
+        }
+
+        if (budgeted) {
+            std::cout << ", spilling above " << budget;
+
+            if (sharedBudget) {
+                std::cout << " or " << shared.limit() << " shared";
+            }
+        }
+
+        if (async) {
+            std::cout << ", async " << POLICY_NAMES[policy] << " ring of " << capacity;
+
+            if (cb.lossy) {
+                std::cout << " dropping " << corpus.packets.size() - cb.delivered();
+            }
+        }
+
+        std::cout << ": " << (cb.failure.empty() ? "ok" : cb.failure) << std::endl;
+    }
+
+    return cb.failure.empty();
+}
+
+static int runFuzz(const Options &options) {
+    if (options.replay) {
+        return fuzzRound(options.seed, true, options.asyncPolicy) ? RET_OK : RET_FAILURE;
+    }
+
+    for (unsigned round = 0; round < options.fuzzRounds; ++round) {
+        unsigned seed = options.seed + round;
+
+        if (!fuzzRound(seed, false, options.asyncPolicy)) {
+            std::cerr << "Replay with -R " << seed;
+
+            if (options.asyncPolicy >= 0) {
+                std::cerr << " -A " << POLICY_NAMES[options.asyncPolicy];
+            }
+
+            std::cerr << std::endl;
+            return RET_FAILURE;
+        }
+    }
+
+    std::cout << options.fuzzRounds << " rounds ok" << std::endl;
+
+    return RET_OK;
+}
+
+/*** loopback and pool ***/
+/**
+ * Callback failing the stream on its first packet
+ */
+struct ThrowingCallback : public ICallback {
+    void BinaryPacket(const char *, unsigned int) override {
+        throw std::runtime_error("binary packet refused");
+    }
+
+    void TextPacket(const char *, unsigned int) override {
+        throw std::runtime_error("text packet refused");
+    }
+};
+
+/**
+ * Checks every stream against its corpus, the one of the stream id
+ * modulo their number. Streams are closed on any thread.
+ */
+struct VerifyingFactory : public ICallbackFactory {
+    const std::vector<Corpus> &corpora;
+    uint64_t throwingStream;            // gets a ThrowingCallback
+    uint64_t refusedStream;             // StreamOpened throws
+    std::mutex mutex;
+    size_t streams;
+    size_t packets;
+    size_t thrown;                      // throwing streams closed
+    std::string failure;                // the first one
+
+    VerifyingFactory(const std::vector<Corpus> &c, uint64_t throwing = UINT64_MAX,
+                     uint64_t refused = UINT64_MAX)
+    : corpora(c), throwingStream(throwing), refusedStream(refused),
+      streams(0), packets(0), thrown(0)
+    {
+    }
+
+    ICallback *StreamOpened(uint64_t streamId) override {
+        if (streamId == refusedStream) {
+            throw std::runtime_error("stream refused");
+        }
+
+        if (streamId == throwingStream) {
+            return new ThrowingCallback;
+        }
+
+        return new VerifyingCallback(corpora[streamId % corpora.size()]);
+    }
+
+    void StreamClosed(uint64_t streamId, ICallback *callback) override {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (streamId == throwingStream) {
+            ++thrown;
+            delete static_cast<ThrowingCallback *>(callback);
+            return;
+        }
+
+        VerifyingCallback *cb = static_cast<VerifyingCallback *>(callback);
+
+        if (cb->failure.empty() && cb->packets != cb->corpus.packets.size()) {
+            cb->failure = std::to_string(cb->corpus.packets.size() - cb->packets) +
+                          " packets lost";
+        }
+
+        if (failure.empty() && !cb->failure.empty()) {
+            failure = "stream " + std::to_string(streamId) + ": " + cb->failure;
+        }
+
+        ++streams;
+        packets += cb->packets;
+        delete cb;
+    }
+};
+
+static int connectTo(const char *kind, int port, const std::string &path) {
+    int fd;
+
+    if (!strcmp(kind, "tcp")) {
+        struct sockaddr_in address;
+
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        if (fd >= 0 && connect(fd, reinterpret_cast<struct sockaddr *>(&address),
+                               sizeof(address)) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        struct sockaddr_un address;
+
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        if (fd >= 0 && connect(fd, reinterpret_cast<struct sockaddr *>(&address),
+                               sizeof(address)) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    return fd;
+}
+
+/**
+ * Packet replay generator: write the corpus in random pieces
+ * of \c chunk bytes on average
+ */
+static bool replay(int fd, const Corpus &corpus, size_t chunk, unsigned seed) {
+    unsigned state = seed;
+    const char *p = corpus.data.data();
+    const char *end = p + corpus.data.size();
+
+    while (p < end) {
+        size_t size = std::min<size_t>(uniform(&state, 1, 2 * chunk - 1), end - p);
+
+        while (size) {
+            ssize_t written = write(fd, p, size);
+
+            if (written < 0) {
+                if (EINTR == errno) {
+                    continue;
+                }
+
+                return false;
+            }
+
+            p += written;
+            size -= written;
+        }
+    }
+
+    return true;
+}
+
+static int runLoopback(const Options &options) {
+    Distribution dist = options.hasCustom ? options.custom : DISTRIBUTIONS[5];
+    Mix mix = options.mix >= 0 ? static_cast<Mix>(options.mix) : MIX_MIXED;
+    std::vector<Corpus> corpora(1, generate(wire<IssFraming>("iss"), mix, dist,
+                                            options.size, options.seed, false));
+    const Corpus &corpus = corpora[0];
+    std::string split = std::string("loopback-") + options.loopback;
+
+    /* connected one after another ahead of the others */
+    const uint64_t throwingStream = 0;
+    const uint64_t refusedStream = 1;
+    const unsigned failing = 2;
+
+    reportHeader();
+
+    for (unsigned repeat = 0; repeat < options.repeat; ++repeat) {
+        VerifyingFactory factory(corpora, throwingStream, refusedStream);
+        SocketFrontend frontend(&factory);
+        MemoryBudget shared(options.sharedBudget);
+
+        frontend.SetMemoryBudget(options.budget,
+                                 SIZE_MAX == options.sharedBudget ? nullptr : &shared);
+        int port = -1;
+        std::string path;
+
+        if (!strcmp(options.loopback, "tcp")) {
+            port = frontend.valid() ? frontend.ListenTcp("127.0.0.1", 0) : -1;
+        } else {
+            const char *tmpDir = getenv("TMPDIR");
+
+            path = std::string(tmpDir ? tmpDir : "/tmp") +
+                   "/iss-bench." + std::to_string(getpid()) + ".sock";
+            port = frontend.valid() && frontend.ListenUnix(path.c_str()) ? 0 : -1;
+        }
+
+        if (port < 0) {
+            perror("Can't listen");
+            return RET_FAILURE;
+        }
+
+        std::thread server([&frontend]() {
+            frontend.Run();
+        });
+
+        std::atomic<unsigned> failed(0);
+
+        /* the throwing one gets a packet, the refused one nothing,
+         * each is closed by the frontend before the next connects */
+        for (uint64_t streamId = 0; streamId < failing && !failed; ++streamId) {
+            int fd = connectTo(options.loopback, port, path);
+
+            if (fd < 0 || (streamId == throwingStream && 7 != write(fd, "one\r\n\r\n", 7))) {
+                ++failed;
+            }
+
+            while (!failed && frontend.stats().closed <= streamId) {
+                usleep(100);
+            }
+
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        Result result;
+        Measurement measurement;
+        std::vector<std::thread> clients;
+
+        for (unsigned idx = 0; idx < options.connections; ++idx) {
+            clients.emplace_back([&, idx]() {
+                int fd = connectTo(options.loopback, port, path);
+
+                if (fd < 0 || !replay(fd, corpus, options.chunk, options.seed + idx)) {
+                    ++failed;
+                }
+
+                if (fd >= 0) {
+                    close(fd);
+                }
+            });
+        }
+
+        for (std::thread &client : clients) {
+            client.join();
+        }
+
+        /* the connections are over once the frontend sees them closed */
+        while (!failed && frontend.stats().closed < options.connections + failing) {
+            usleep(100);
+        }
+
+        measurement.finish(result);
+        frontend.Stop();
+        server.join();
+
+        if (failed) {
+            perror("Can't replay");
+            return RET_FAILURE;
+        }
+
+        if (factory.failure.empty() && factory.streams != options.connections) {
+            factory.failure = std::to_string(factory.streams) + " of " +
+                              std::to_string(options.connections) + " connections closed";
+        }
+
+        if (factory.failure.empty() && (1 != factory.thrown || failing != frontend.stats().errors)) {
+            factory.failure = "throwing connection closed " + std::to_string(factory.thrown) +
+                              " times, " + std::to_string(frontend.stats().errors) +
+                              " errors counted";
+        }
+
+        if (factory.failure.empty() && shared.used()) {
+            factory.failure = std::to_string(shared.used()) + " bytes of the shared budget leaked";
+        }
+
+        if (!factory.failure.empty()) {
+            std::cerr << factory.failure << std::endl;
+            return RET_FAILURE;
+        }
+
+        result.bytes = corpus.data.size() * options.connections;
+        result.packets = factory.packets;
+
+        report(options, dist, mix, split.c_str(), result);
+    }
+
+    return RET_OK;
+}
+
+/**
+ * Interleave the chunks of many streams through ReceiverPool
+ */
+static int runPool(const Options &options) {
+    Distribution dist = options.hasCustom ? options.custom : DISTRIBUTIONS[5];
+    Mix mix = options.mix >= 0 ? static_cast<Mix>(options.mix) : MIX_MIXED;
+    size_t streams = options.poolStreams;
+    size_t streamSize = std::max<size_t>(options.size / streams, 1);
+    std::vector<Corpus> corpora;
+    std::vector<std::vector<struct iovec>> chunks;
+
+    for (size_t idx = 0; idx < streams; ++idx) {
+        corpora.push_back(generate(wire<IssFraming>("iss"), mix, dist, streamSize,
+                                   options.seed + idx, false));
+        chunks.push_back(slice(corpora.back(), SPLIT_RANDOM, options.chunk, options.seed + idx));
+    }
+
+    /* chunks in the order they are received, streams picked at random */
+    std::vector<std::pair<uint64_t, const struct iovec *>> schedule;
+    std::vector<size_t> next(streams, 0);
+    std::vector<uint64_t> pending;
+    unsigned state = options.seed;
+    size_t bytes = 0;
+
+    for (size_t idx = 0; idx < streams; ++idx) {
+        bytes += corpora[idx].data.size();
+
+        if (!chunks[idx].empty()) {
+            pending.push_back(idx);
+        }
+    }
+
+    while (!pending.empty()) {
+        size_t pick = rand_r(&state) % pending.size();
+        uint64_t streamId = pending[pick];
+
+        schedule.emplace_back(streamId, &chunks[streamId][next[streamId]]);
+
+        if (++next[streamId] == chunks[streamId].size()) {
+            pending[pick] = pending.back();
+            pending.pop_back();
+        }
+    }
+
+    const uint64_t throwingStream = streams;
+    std::string split = "pool";
+
+    reportHeader();
+
+    for (unsigned repeat = 0; repeat < options.repeat; ++repeat) {
+        VerifyingFactory factory(corpora, throwingStream);
+        ReceiverPool pool(&factory, options.shards);
+        MemoryBudget shared(options.sharedBudget);
+
+        pool.SetMemoryBudget(options.budget,
+                             SIZE_MAX == options.sharedBudget ? nullptr : &shared);
+
+        Result result;
+        Measurement measurement;
+
+        /* the second packet is dropped along with the failed stream */
+        pool.Receive(throwingStream, "one\r\n\r\n", 7);
+
+        for (const auto &entry : schedule) {
+            pool.Receive(entry.first, reinterpret_cast<const char *>(entry.second->iov_base),
+                         entry.second->iov_len);
+        }
+
+        pool.Receive(throwingStream, "two\r\n\r\n", 7);
+
+        for (uint64_t streamId = 0; streamId <= throwingStream; ++streamId) {
+            pool.Close(streamId);
+        }
+
+        pool.Drain();
+        measurement.finish(result);
+
+        uint64_t errors = 0;
+
+        for (size_t idx = 0; idx < pool.shards(); ++idx) {
+            errors += pool.stats(idx).errors;
+        }
+
+        if (factory.failure.empty() && factory.streams != streams) {
+            factory.failure = std::to_string(factory.streams) + " of " +
+                              std::to_string(streams) + " streams closed";
+        }
+
+        if (factory.failure.empty() && (1 != factory.thrown || 1 != errors)) {
+            factory.failure = "throwing stream closed " + std::to_string(factory.thrown) +
+                              " times, " + std::to_string(errors) + " errors counted";
+        }
+
+        if (factory.failure.empty() && shared.used()) {
+            factory.failure = std::to_string(shared.used()) + " bytes of the shared budget leaked";
+        }
+
+        if (!factory.failure.empty()) {
+            std::cerr << factory.failure << std::endl;
+            return RET_FAILURE;
+        }
+
+        result.bytes = bytes;
+        result.packets = factory.packets;
+
+        report(options, dist, mix, split.c_str(), result);
+    }
+
+    return RET_OK;
+}
+
+static void printUsage(const char *argv0) {
+    std::cerr << "Usage: "
+              << argv0
+              << " [-s megabytes] [-c chunk] [-r repeat] [-S seed] [-t tag] [-d min:max] [-m mix]"
+              << " [-M budget]"
+              << std::endl
+              << "       "
+              << argv0
+              << " -F rounds [-S seed] | -R seed [-A block|drop|grow]"
+              << std::endl
+              << "       "
+              << argv0
+              << " -L tcp|unix [-n connections] [-s megabytes] [-c chunk] [-r repeat] [-d min:max] [-m mix]"
+              << " [-M budget]"
+              << std::endl
+              << "       "
+              << argv0
+              << " -P streams [-j shards] [-s megabytes] [-c chunk] [-r repeat] [-d min:max] [-m mix]"
+              << " [-M budget]"
+              << std::endl
+              << "  -s  corpus size per distribution, defaults to 64"
+              << std::endl
+              << "  -c  chunk size in bytes, the average one for random splits,"
+              << std::endl
+              << "      defaults to 1024"
+              << std::endl
+              << "  -r  repeat each benchmark and report the best run, defaults to 3"
+              << std::endl
+              << "  -S  data generator seed, the first fuzz round seed"
+              << std::endl
+              << "  -t  tag for the report rows e.g. commit id"
+              << std::endl
+              << "  -d  packet sizes uniformly distributed in [min, max]"
+              << std::endl
+              << "      instead of the built in distributions"
+              << std::endl
+              << "  -m  text, binary or mixed packets only"
+              << std::endl
+              << "  -F  run fuzz rounds checking delivered packets"
+              << std::endl
+              << "  -R  replay a single fuzz round"
+              << std::endl
+              << "  -A  deliver every fuzz round through AsyncCallback with this"
+              << std::endl
+              << "      backpressure policy instead of a third of them with any"
+              << std::endl
+              << "  -L  replay the corpus over loopback connections to SocketFrontend,"
+              << std::endl
+              << "      packets of the task distribution by default"
+              << std::endl
+              << "  -n  loopback connections, defaults to 4"
+              << std::endl
+              << "  -P  interleave the chunks of this many streams through ReceiverPool,"
+              << std::endl
+              << "      -s megabytes in total"
+              << std::endl
+              << "  -j  ReceiverPool shards, the number of CPUs by default"
+              << std::endl
+              << "  -M  receiver[:shared] memory budget in KiB, packets exceeding it"
+              << std::endl
+              << "      are spilled to files in $TMPDIR"
+              << std::endl;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "s:c:r:S:t:d:m:F:R:A:L:n:P:j:M:"))) {
+        switch (opt) {
+            case 's':
+                options.size = strtoul(optarg, NULL, 0) << 20;
+                break;
+
+            case 'c':
+                options.chunk = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'r':
+                options.repeat = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'S':
+                options.seed = strtoul(optarg, NULL, 0);
+                break;
+
+            case 't':
+                options.tag = optarg;
+                break;
+
+            case 'd': {
+                char *end;
+
+                options.custom.minSize = strtoul(optarg, &end, 0);
+                options.custom.maxSize = ':' == *end ?
+                                             strtoul(end + 1, NULL, 0) :
+                                             options.custom.minSize;
+                options.hasCustom = options.custom.minSize <= options.custom.maxSize;
+
+                if (!options.hasCustom) {
+                    printUsage(argv[0]);
+                    return RET_INVALID_ARGS;
+                }
+
+                break;
+            }
+
+            case 'm':
+                for (int mix = 0; mix < _MIX_COUNT; ++mix) {
+                    if (!strcmp(optarg, MIX_NAMES[mix])) {
+                        options.mix = mix;
+                    }
+                }
+
+                if (options.mix < 0) {
+                    printUsage(argv[0]);
+                    return RET_INVALID_ARGS;
+                }
+
+                break;
+
+            case 'F':
+                options.fuzzRounds = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'R':
+                options.seed = strtoul(optarg, NULL, 0);
+                options.replay = true;
+                break;
+
+            case 'A':
+                for (int policy = 0; policy < 3; ++policy) {
+                    if (!strcmp(optarg, POLICY_NAMES[policy])) {
+                        options.asyncPolicy = policy;
+                    }
+                }
+
+                if (options.asyncPolicy < 0) {
+                    printUsage(argv[0]);
+                    return RET_INVALID_ARGS;
+                }
+
+                break;
+
+            case 'L':
+                if (strcmp(optarg, "tcp") && strcmp(optarg, "unix")) {
+                    printUsage(argv[0]);
+                    return RET_INVALID_ARGS;
+                }
+
+                options.loopback = optarg;
+                break;
+
+            case 'n':
+                options.connections = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'P':
+                options.poolStreams = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'j':
+                options.shards = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'M': {
+                char *end;
+
+                options.budget = strtoul(optarg, &end, 0) << 10;
+
+                if (':' == *end) {
+                    options.sharedBudget = strtoul(end + 1, NULL, 0) << 10;
+                }
+
+                break;
+            }
+
+            default:
+                printUsage(argv[0]);
+                return RET_INVALID_ARGS;
+        }
+    }
+
+    if (!options.repeat) {
+        options.repeat = 1;
+    }
+
+    if (!options.chunk) {
+        options.chunk = 1;
+    }
+
+    if (options.fuzzRounds || options.replay) {
+        return runFuzz(options);
+    }
+
+    if (options.loopback) {
+        return runLoopback(options);
+    }
+
+    if (options.poolStreams) {
+        return runPool(options);
+    }
+
+    return runBenchmarks(options);
+}
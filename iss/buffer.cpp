@@ -0,0 +1,168 @@
+#include "buffer.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include <utility>
+
+Buffer::Buffer()
+: _data(nullptr),
+  _size(0),
+  _capacity(0)
+{
+}
+
+Buffer::~Buffer()
+{
+    free(_data);
+}
+
+Buffer::Buffer(Buffer &&rhs)
+: _data(rhs._data),
+  _size(rhs._size),
+  _capacity(rhs._capacity)
+{
+    rhs._data = nullptr;
+    rhs._size = 0;
+    rhs._capacity = 0;
+}
+
+Buffer &Buffer::operator=(Buffer &&rhs)
+{
+    if (this != &rhs) {
+        free(_data);
+
+        _data = rhs._data;
+        _size = rhs._size;
+        _capacity = rhs._capacity;
+
+        rhs._data = nullptr;
+        rhs._size = 0;
+        rhs._capacity = 0;
+    }
+
+    return *this;
+}
+
+void Buffer::reserve(size_t capacity)
+{
+    if (capacity <= _capacity) {
+        return;
+    }
+
+    if (capacity < 2 * _capacity) {
+        capacity = 2 * _capacity;
+    }
+
+    char *data = reinterpret_cast<char *>(realloc(_data, capacity));
+
+    if (!data) {
+        throw std::bad_alloc();
+    }
+
+    _data = data;
+    _capacity = capacity;
+}
+
+void Buffer::append(const char *data, size_t size)
+{
+    if (!size) {
+        // an empty buffer has no storage to copy into
+        return;
+    }
+
+    reserve(_size + size);
+
+    memcpy(_data + _size, data, size);
+    _size += size;
+}
+
+Buffer BufferPool::acquire()
+{
+    if (_free.empty()) {
+        return Buffer();
+    }
+
+    Buffer buffer = std::move(_free.back());
+    _free.pop_back();
+
+    return buffer;
+}
+
+void BufferPool::release(Buffer &&buffer)
+{
+    if (!buffer.capacity()) {
+        return;
+    }
+
+    if (_free.size() >= MAX_BUFFERS || buffer.capacity() > MAX_CAPACITY) {
+        Buffer dropped = std::move(buffer);
+        return;
+    }
+
+    buffer.clear();
+    _free.push_back(std::move(buffer));
+}
+
+BufferPool &BufferPool::local()
+{
+    static thread_local BufferPool pool;
+
+    return pool;
+}
+
+Slab::Slab(size_t objectSize, size_t objectsPerBlock)
+: _objectSize(std::max(objectSize, sizeof(FreeObject))),
+  _objectsPerBlock(objectsPerBlock ? objectsPerBlock : 1),
+  _free(nullptr)
+{
+    const size_t align = alignof(std::max_align_t);
+
+    _objectSize = (_objectSize + align - 1) / align * align;
+}
+
+Slab::~Slab()
+{
+    for (char *block : _blocks) {
+        ::operator delete(block);
+    }
+}
+
+void *Slab::allocate()
+{
+    if (!_free) {
+        /* thread the new block onto the free list */
+        _blocks.reserve(_blocks.size() + 1);
+
+        char *block = reinterpret_cast<char *>(::operator new(_objectSize * _objectsPerBlock));
+
+        _blocks.push_back(block);
+
+        for (size_t idx = _objectsPerBlock; idx > 0; --idx) {
+            FreeObject *object = reinterpret_cast<FreeObject *>(block + (idx - 1) * _objectSize);
+
+            object->next = _free;
+            _free = object;
+        }
+    }
+
+    FreeObject *object = _free;
+
+    _free = object->next;
+
+    return object;
+}
+
+void Slab::free(void *object)
+{
+    if (!object) {
+        return;
+    }
+
+    FreeObject *freed = reinterpret_cast<FreeObject *>(object);
+
+    freed->next = _free;
+    _free = freed;
+}
@@ -0,0 +1,148 @@
+#ifndef ISS_BUFFER_H
+#define ISS_BUFFER_H 1
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Growable byte buffer to assemble a packet straddling chunks.
+ * Grows geometrically, keeps its capacity when cleared.
+ */
+struct Buffer {
+private:
+    /************************ data ************************/
+    char *_data;
+    size_t _size;
+    size_t _capacity;
+
+public:
+    Buffer();
+    ~Buffer();
+
+    Buffer(Buffer &&rhs);
+    Buffer &operator=(Buffer &&rhs);
+
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+
+    const char *data() const {
+        return _data;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    size_t capacity() const {
+        return _capacity;
+    }
+
+    bool empty() const {
+        return !_size;
+    }
+
+    /**
+     * Ensure capacity of at least \c capacity bytes,
+     * at least doubles the current one
+     * \throw std::bad_alloc
+     */
+    void reserve(size_t capacity);
+
+    /**
+     * Append \c size bytes to the end
+     * \throw std::bad_alloc
+     */
+    void append(const char *data, size_t size);
+
+    /**
+     * Drop \c size bytes off the end
+     */
+    void truncate(size_t size) {
+        _size = size < _size ? _size - size : 0;
+    }
+
+    void clear() {
+        _size = 0;
+    }
+};
+
+/**
+ * Free list of assembly buffers shared by receivers of a thread.
+ *
+ * A receiver takes a buffer only while a packet straddles chunks
+ * and gives it back once the packet is delivered, so idle receivers
+ * hold no memory and the grown capacity is reused by the others.
+ * Not thread-safe, see \c local.
+ */
+struct BufferPool {
+    static const size_t MAX_BUFFERS = 64;
+    static const size_t MAX_CAPACITY = 1 << 20;     // larger ones are freed
+
+private:
+    /************************ data ************************/
+    std::vector<Buffer> _free;
+
+public:
+    /**
+     * Take a buffer, empty but possibly with some capacity
+     */
+    Buffer acquire();
+
+    /**
+     * Give a buffer back
+     */
+    void release(Buffer &&buffer);
+
+    size_t size() const {
+        return _free.size();
+    }
+
+    /**
+     * Pool of the calling thread
+     */
+    static BufferPool &local();
+};
+
+/**
+ * Allocator of fixed size objects carved out of larger blocks.
+ *
+ * Freed objects are kept in an intrusive free list and reused,
+ * blocks are only given back upon destruction.
+ * Not thread-safe.
+ */
+struct Slab {
+    static const size_t DEFAULT_OBJECTS_PER_BLOCK = 64;
+
+private:
+    /************************ types ************************/
+    struct FreeObject {
+        FreeObject *next;
+    };
+
+    /************************ data ************************/
+    size_t _objectSize;
+    size_t _objectsPerBlock;
+    std::vector<char *> _blocks;
+    FreeObject *_free;
+
+public:
+    Slab(size_t objectSize, size_t objectsPerBlock = DEFAULT_OBJECTS_PER_BLOCK);
+    ~Slab();
+
+    Slab(const Slab &) = delete;
+    Slab &operator=(const Slab &) = delete;
+
+    /**
+     * \return storage for an object, suitably aligned for any type
+     * \throw std::bad_alloc
+     */
+    void *allocate();
+
+    void free(void *object);
+
+    size_t objectSize() const {
+        return _objectSize;
+    }
+};
+
+#endif  /* ISS_BUFFER_H */
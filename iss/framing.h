@@ -0,0 +1,73 @@
+#ifndef ISS_FRAMING_H
+#define ISS_FRAMING_H 1
+
+#include "search.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Packet framing of a protocol, the policy BasicReceiver is parametrized with.
+ *
+ * A binary packet is the start marker followed by the packet size
+ * of LengthSize bytes and the packet data. Anything else is a text
+ * packet running up to the terminator.
+ *
+ * Everything is known at compile time so that the size is decoded
+ * with a single load (and byte swap) and the terminator comparisons
+ * are of constant length.
+ */
+template <char Start, size_t LengthSize, bool LengthBigEndian, char... Finish>
+struct Framing {
+    static_assert(LengthSize > 0 && LengthSize <= sizeof(uint32_t),
+                  "packet size must fit unsigned int");
+    static_assert(sizeof...(Finish) > 0, "text packets need a terminator");
+
+    static constexpr char BINARY_PKT_START = Start;
+    static constexpr size_t LENGTH_SIZE = LengthSize;
+    static constexpr bool LENGTH_BIG_ENDIAN = LengthBigEndian;
+    static constexpr char TEXT_PKT_FINISH[] = { Finish... };
+    static constexpr size_t TEXT_PKT_FINISH_LEN = sizeof...(Finish);
+
+    /**
+     * \param header LENGTH_SIZE bytes following the start marker
+     */
+    static uint32_t packetSize(const char *header) {
+        const bool hostBigEndian = __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
+        uint32_t size = 0;
+
+        /* a fixed size copy into the low order bytes is a single load */
+        memcpy(reinterpret_cast<char *>(&size) + (hostBigEndian ? sizeof(size) - LENGTH_SIZE : 0),
+               header, LENGTH_SIZE);
+
+        if (hostBigEndian != LENGTH_BIG_ENDIAN) {
+            size = __builtin_bswap32(size) >> 8 * (sizeof(size) - LENGTH_SIZE);
+        }
+
+        return size;
+    }
+
+    /**
+     * \return pointer to the first terminator in data or nullptr
+     */
+    static const char *findFinish(const char *data, size_t size) {
+        if (1 == TEXT_PKT_FINISH_LEN) {
+            /* nothing to filter candidates by but the byte itself */
+            return reinterpret_cast<const char *>(memchr(data, TEXT_PKT_FINISH[0], size));
+        }
+
+        return findPattern(data, size, TEXT_PKT_FINISH, TEXT_PKT_FINISH_LEN);
+    }
+};
+
+/* the definition is required before C++17 */
+template <char Start, size_t LengthSize, bool LengthBigEndian, char... Finish>
+constexpr char Framing<Start, LengthSize, LengthBigEndian, Finish...>::TEXT_PKT_FINISH[];
+
+/**
+ * The task protocol: '$', 4 bytes LSB size, "\r\n\r\n"
+ */
+typedef Framing<'\x24', 4, false, '\r', '\n', '\r', '\n'> IssFraming;
+
+#endif  /* ISS_FRAMING_H */
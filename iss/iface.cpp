@@ -8,3 +8,7 @@ ICallback::~ICallback()
 {
 }
 
+ICallbackFactory::~ICallbackFactory()
+{
+}
+
@@ -1,6 +1,8 @@
 #ifndef ISS_IFACE_H
 #define ISS_IFACE_H 1
 
+#include <cstdint>
+
 struct IReceiver {
   virtual void Receive(const char* data, unsigned int size) = 0;
   virtual ~IReceiver();
@@ -13,4 +15,33 @@ struct ICallback
     virtual ~ICallback();
 };
 
+/*
+ * Opt-in extension of ICallback for packets too big to be buffered.
+ * Packets up to the receiver threshold still arrive whole through
+ * BinaryPacket/TextPacket, bigger ones are streamed as
+ * PacketBegin, zero or more PacketFragment and PacketEnd.
+ */
+struct IStreamCallback : public ICallback
+{
+    /* size is the whole packet size for binary packets
+     * and 0 (unknown yet) for text ones */
+    virtual void PacketBegin(bool binary, unsigned int size) = 0;
+    virtual void PacketFragment(const char* data, unsigned int size) = 0;
+    virtual void PacketEnd() = 0;
+};
+
+/*
+ * Provides callbacks for the streams of ReceiverPool and SocketFrontend.
+ * Both methods are called on the thread owning the stream.
+ */
+struct ICallbackFactory
+{
+    /* a stream got its first chunk, returns its callback,
+     * an IStreamCallback opts in streaming */
+    virtual ICallback* StreamOpened(uint64_t streamId) = 0;
+    /* the stream is closed, no more packets are delivered to callback */
+    virtual void StreamClosed(uint64_t streamId, ICallback* callback) = 0;
+    virtual ~ICallbackFactory();
+};
+
 #endif  /* ISS_IFACE_H */
@@ -2,43 +2,44 @@
 #define ISS_RECEIVER_H 1
 
 #include "iface.h"
+#include "buffer.h"
+#include "framing.h"
+#include "spill.h"
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <utility>
 
-struct Receiver : public IReceiver {
+#include <sys/uio.h>
+
+/**
+ * Parses the stream of packets framed as Protocol tells, see Framing.
+ * Receiver is the one for the task protocol, the sibling protocols
+ * share the same engine with their own Framing.
+ */
+template <class Protocol>
+struct BasicReceiver : public IReceiver {
 private:
     /************************ types ************************/
-    enum PacketType {
-        PT_NONE     = 0,
-        PT_BINARY,
-        PT_TEXT,
-
-        _PT_SIZE
-    };
-
-    enum BinaryPacketState {
-        BPS_NONE    = 0,
-        BPS_HEADER,
-        BPS_DATA,
-
-        _BPS_COUNT
+    enum ParserState {
+        PS_NONE     = 0,            // new packet of unknown type
+        PS_BINARY_HEADER,           // binary pkt size
+        PS_BINARY_DATA,             // binary pkt data
+        PS_TEXT,                    // text pkt data up to terminator
     };
 
     struct PacketDescr {
-        /* data from header */
-        PacketType type;
+        ParserState state;
         uint32_t packetSize;        // only used for binary pkt
-        size_t textStart;           // only used for text pkt
-
-        char *data;                 // actual data
-
-        // offset < actualDataSize < reservedDataSize
-        size_t actualDataSize;      // mem used
-        size_t reservedDataSize;    // mem alloc'ed
-        size_t offset;
-
-        BinaryPacketState binaryPacketState;
+        char header[Protocol::LENGTH_SIZE];     // binary pkt header collected so far
+        size_t headerSize;
+        size_t termMatched;         // text pkt terminator bytes matched at
+                                    // the end of the data scanned so far
+        bool streaming;             // delivered with IStreamCallback events
+        uint32_t streamed;          // binary pkt bytes streamed so far
     };
 
     struct Chunk {
@@ -46,76 +47,666 @@ private:
         unsigned int size;
     };
 
-    typedef void (Receiver::*ChunkProcessor)();
-    typedef void (ICallback::*ReceivedPktCallback)(const char *data, unsigned int size);
-    typedef void (Receiver::*BinaryPacketProcessor)();
-
     /************************ data ************************/
-    static const ChunkProcessor CHUNK_PROCESSOR[_PT_SIZE];
-    static const ReceivedPktCallback RECEIVED_PKT_CALLBACK[_PT_SIZE];
-    static const BinaryPacketProcessor BINARY_PACKET_PROCESSOR[_BPS_COUNT];
-    static const char* BINARY_PKT_START;
-    static size_t BINARY_PKT_START_LEN;
-    static const char* TEXT_PKT_FINISH;
-    static size_t TEXT_PKT_FINISH_LEN;
+    static constexpr char BINARY_PKT_START = Protocol::BINARY_PKT_START;
+    static constexpr const char* TEXT_PKT_FINISH = Protocol::TEXT_PKT_FINISH;
+    static constexpr size_t TEXT_PKT_FINISH_LEN = Protocol::TEXT_PKT_FINISH_LEN;
 
     ICallback* _callback;
+    IStreamCallback* _streamCallback;   // nil unless streaming is opted in
+    size_t _streamThreshold;
+    BufferPool* _pool;
     PacketDescr _currentPacket;
+    Chunk _chunk;                   // the rest of the chunk being parsed
+    Buffer _assembly;               // the packet straddling chunks, if any
+    size_t _budget;                 // heap _assembly may take
+    MemoryBudget* _sharedBudget;    // nil if there is none
+    size_t _charged;                // to the budgets for the current packet
+    SpillFile _spill;               // the packet exceeding the budgets, if any
 
     /************************ methods ************************/
-    /*** misc work with _currentPacket and data ***/
+    /*** misc work with _chunk and _assembly ***/
     /**
-     * Fetch amount of data available in {\code _currentPacket}
-     * \return number of bytes available since offset
+     * Fetch amount of data available in {\code _chunk}
+     * \return number of bytes not parsed yet
      */
     size_t dataAvailable() const;
     /**
-     * \return current offset
+     * mark amount of chunk data as parsed
      */
-    size_t dataRead() const;
-    /**
-     * add amount to offset
-     * \return new offset
-     */
-    size_t dataRead(size_t amount);
+    void dataRead(size_t amount);
     /**
      * \return pointer to currently read data
      */
     const char *getData() const;
 
-    bool ensureDataAvailable(size_t required);
+    bool ensureDataAvailable(size_t required) const;
 
-    int32_t lsbToHost(int32_t v);
+    /**
+     * Move amount of chunk data to _assembly
+     * taking a buffer from the pool if there is none yet,
+     * or to _spill once _assembly is out of the budgets
+     */
+    void append(size_t amount);
+    /**
+     * Make room for the whole packet in _assembly
+     * or in _spill if it's out of the budgets
+     */
+    void reserve(size_t packetSize);
+    /**
+     * Give _assembly back to the pool, drop _spill
+     */
+    void releaseAssembly();
 
     /**
-     * dismiss currently read data (till offset)
+     * \return bytes of the current packet assembled so far
      */
-    void shift();
+    size_t assembled() const;
+    const char *assembledData();
+    void truncateAssembled(size_t size);
+
+    /*** memory budget ***/
     /**
-     * Store another chunk in the end of _currentPacket.data
+     * Charge the budgets with total bytes of the packet
+     * \return \c false if it exceeds any of them
      */
-    void append(const Chunk &chunk);
+    bool charge(size_t total);
+    void uncharge();
+    /**
+     * Move what _assembly holds to _spill
+     */
+    void spill();
 
     /*** packet processors ***/
+    /**
+     * Run the state machine until the chunk is consumed.
+     * Each processor below handles a single state and either
+     * moves to another one or consumes the rest of the chunk.
+     */
     void anotherChunkReceived(const Chunk &chunk);
-    void anotherChunkReceivedImpl();
     void packetStarted();
-    void packetContinueBinary();
     void packetContinueText();
 
-    void packetFinished(const char *data, size_t packetSize, size_t sizeToRead);
+    void packetFinished(const char *data, size_t packetSize);
 
     void binaryPacketHeader();
     void binaryPacketData();
 
-    const char *memmem(const char *haystack, size_t haystackLen,
-                       const char *needle, size_t needleLen) const;
+    /**
+     * Check if the terminator partially matched at the end of the
+     * previous chunk completes at the start of the current one
+     * \return number of terminator bytes in the previous data or nil
+     */
+    size_t terminatorStraddles() const;
+    /**
+     * Remember how much of the terminator the chunk ends with
+     */
+    void rememberTerminatorMatch();
+
+    /*** streaming of big packets ***/
+    /**
+     * Switch the current packet to streaming,
+     * the text data assembled so far is flushed
+     */
+    void streamStarted(bool binary);
+    void streamFragment(const char *data, size_t size);
+    void streamFinished();
+    void streamBinary();
+    /**
+     * Pass the chunk through holding back the bytes which might turn
+     * out to be the terminator. They are equal to its beginning
+     * thus they are not stored anywhere.
+     */
+    void streamText();
 
 public:
-    Receiver(ICallback* callback);
-    ~Receiver();
+    static const size_t DEFAULT_STREAM_THRESHOLD = 1 << 20;
+
+    /**
+     * \param pool where to take assembly buffers from,
+     *             the pool of the calling thread by default
+     */
+    BasicReceiver(ICallback* callback, BufferPool* pool = nullptr);
+    /**
+     * Packets exceeding streamThreshold are streamed through callback
+     * events instead of being assembled. Text packets are streamed
+     * once more than streamThreshold bytes of them are pending.
+     * \param pool the same as above
+     */
+    BasicReceiver(IStreamCallback* callback,
+                  size_t streamThreshold = DEFAULT_STREAM_THRESHOLD,
+                  BufferPool* pool = nullptr);
+    ~BasicReceiver();
 
     void Receive(const char *data, unsigned int size) override;
+
+    /**
+     * Parse a batch of consecutive chunks of the stream in one go,
+     * e.g. everything recvmmsg (2) returned. The same as calling
+     * Receive for each chunk without a virtual call per chunk.
+     * Only the packets straddling chunks are copied.
+     */
+    void ReceiveBatch(const struct iovec *chunks, size_t count);
+
+    /**
+     * Bound the heap packets straddling chunks are assembled in.
+     * A packet is spilled to a temporary file once assembling it would
+     * take more than budget bytes or more than is left of shared,
+     * the callback gets a read-only mapping of the file then.
+     * The receiver assembles one packet at a time, so budget is
+     * a packet size threshold as well. To be set before any data.
+     * \param shared budget of many receivers, may be nil
+     */
+    void SetMemoryBudget(size_t budget, MemoryBudget* shared = nullptr);
 };
 
+template <class Protocol>
+BasicReceiver<Protocol>::BasicReceiver(ICallback* callback, BufferPool* pool)
+: _callback(callback),
+  _streamCallback(nullptr),
+  _streamThreshold(0),
+  _pool(pool ? pool : &BufferPool::local()),
+  _currentPacket{PS_NONE, 0, {}, 0, 0, false, 0},
+  _chunk{nullptr, 0},
+  _budget(SIZE_MAX),
+  _sharedBudget(nullptr),
+  _charged(0)
+{
+}
+
+template <class Protocol>
+BasicReceiver<Protocol>::BasicReceiver(IStreamCallback* callback, size_t streamThreshold,
+                                       BufferPool* pool)
+: BasicReceiver(static_cast<ICallback *>(callback), pool)
+{
+    _streamCallback = callback;
+    _streamThreshold = streamThreshold;
+}
+
+template <class Protocol>
+BasicReceiver<Protocol>::~BasicReceiver()
+{
+    releaseAssembly();
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::Receive(const char* data, unsigned int size)
+{
+    anotherChunkReceived(Chunk{data, size});
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::ReceiveBatch(const struct iovec *chunks, size_t count)
+{
+    for (const struct iovec *chunk = chunks; chunk < chunks + count; ++chunk) {
+        const char *data = reinterpret_cast<const char *>(chunk->iov_base);
+        size_t size = chunk->iov_len;
+
+        /* Chunk size is limited by the IReceiver interface */
+        while (size) {
+            unsigned int amount = std::min<size_t>(size, UINT_MAX);
+
+            anotherChunkReceived(Chunk{data, amount});
+            data += amount;
+            size -= amount;
+        }
+    }
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::anotherChunkReceived(const Chunk& chunk)
+{
+    if (chunk.size == 0) {
+        return;
+    }
+
+    _chunk = chunk;
+
+    /* as many packets as the chunk contains, without recursion */
+    while (dataAvailable()) {
+        switch (_currentPacket.state) {
+        case PS_NONE:
+            packetStarted();
+            break;
+        case PS_BINARY_HEADER:
+            binaryPacketHeader();
+            break;
+        case PS_BINARY_DATA:
+            binaryPacketData();
+            break;
+        case PS_TEXT:
+            packetContinueText();
+            break;
+        }
+    }
+
+    _chunk = Chunk{nullptr, 0};
+}
+
+template <class Protocol>
+size_t BasicReceiver<Protocol>::dataAvailable() const
+{
+    return _chunk.size;
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::dataRead(size_t amount)
+{
+    _chunk.data += amount;
+    _chunk.size -= amount;
+}
+
+template <class Protocol>
+const char *BasicReceiver<Protocol>::getData() const
+{
+    return _chunk.data;
+}
+
+template <class Protocol>
+bool BasicReceiver<Protocol>::ensureDataAvailable(size_t required) const
+{
+    return dataAvailable() >= required;
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::SetMemoryBudget(size_t budget, MemoryBudget* shared)
+{
+    _budget = budget;
+    _sharedBudget = shared;
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::append(size_t amount)
+{
+    if (!_spill.active() && !charge(_assembly.size() + amount)) {
+        spill();
+    }
+
+    if (_spill.active()) {
+        _spill.append(getData(), amount);
+        dataRead(amount);
+        return;
+    }
+
+    if (!_assembly.capacity()) {
+        _assembly = _pool->acquire();
+    }
+
+    _assembly.append(getData(), amount);
+    dataRead(amount);
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::reserve(size_t packetSize)
+{
+    if (!charge(packetSize)) {
+        spill();
+        return;
+    }
+
+    if (!_assembly.capacity()) {
+        _assembly = _pool->acquire();
+    }
+
+    _assembly.reserve(packetSize);
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::releaseAssembly()
+{
+    /* nothing to do for the packets delivered in place */
+    if (_assembly.capacity()) {
+        _pool->release(std::move(_assembly));
+    }
+
+    if (_charged) {
+        uncharge();
+    }
+
+    if (_spill.active()) {
+        _spill.close();
+    }
+}
+
+template <class Protocol>
+size_t BasicReceiver<Protocol>::assembled() const
+{
+    return _spill.active() ? _spill.size() : _assembly.size();
+}
+
+template <class Protocol>
+const char *BasicReceiver<Protocol>::assembledData()
+{
+    return _spill.active() ? _spill.map() : _assembly.data();
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::truncateAssembled(size_t size)
+{
+    if (_spill.active()) {
+        _spill.truncate(size);
+    } else {
+        _assembly.truncate(size);
+    }
+}
+
+template <class Protocol>
+bool BasicReceiver<Protocol>::charge(size_t total)
+{
+    if (total <= _charged) {
+        return true;
+    }
+
+    if (total > _budget ||
+        (_sharedBudget && !_sharedBudget->acquire(total - _charged))) {
+        return false;
+    }
+
+    _charged = total;
+
+    return true;
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::uncharge()
+{
+    if (_sharedBudget) {
+        _sharedBudget->release(_charged);
+    }
+
+    _charged = 0;
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::spill()
+{
+    _spill.open();
+    _spill.append(_assembly.data(), _assembly.size());
+
+    /* the heap part is given back right away */
+    _pool->release(std::move(_assembly));
+    uncharge();
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::packetStarted()
+{
+    /* parse packet type, the chunk is never empty here */
+
+    if (BINARY_PKT_START == *getData()) {
+        _currentPacket.state = PS_BINARY_HEADER;
+        _currentPacket.headerSize = 0;
+
+        dataRead(sizeof(BINARY_PKT_START));
+    } else {
+        _currentPacket.state = PS_TEXT;
+        _currentPacket.termMatched = 0;
+    }
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::binaryPacketHeader()
+{
+    /* parse packet size, it might straddle chunks as well */
+    size_t amount = std::min(sizeof(_currentPacket.header) - _currentPacket.headerSize,
+                             dataAvailable());
+
+    memcpy(_currentPacket.header + _currentPacket.headerSize, getData(), amount);
+    _currentPacket.headerSize += amount;
+    dataRead(amount);
+
+    if (_currentPacket.headerSize < sizeof(_currentPacket.header)) {
+        // just wait a bit
+        return;
+    }
+
+    _currentPacket.packetSize = Protocol::packetSize(_currentPacket.header);
+
+    _currentPacket.state = PS_BINARY_DATA;
+
+    if (!_currentPacket.packetSize) {
+        /* nothing to wait for, even if the chunk is over */
+        packetFinished(getData(), 0);
+    }
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::binaryPacketData()
+{
+    if (_currentPacket.streaming) {
+        streamBinary();
+        return;
+    }
+
+    bool assembling = assembled();
+
+    if (!assembling && ensureDataAvailable(_currentPacket.packetSize)) {
+        /* the whole packet is within the chunk, deliver it in place */
+        const char *data = getData();
+
+        dataRead(_currentPacket.packetSize);
+        packetFinished(data, _currentPacket.packetSize);
+        return;
+    }
+
+    if (!assembling && _streamCallback &&
+        _currentPacket.packetSize > _streamThreshold) {
+        streamStarted(true);
+        streamBinary();
+        return;
+    }
+
+    if (!assembling) {
+        reserve(_currentPacket.packetSize);
+    }
+
+    append(std::min(_currentPacket.packetSize - assembled(), dataAvailable()));
+
+    if (assembled() < _currentPacket.packetSize) {
+        // just wait a bit
+        return;
+    }
+
+    packetFinished(assembledData(), _currentPacket.packetSize);
+}
+
+
+template <class Protocol>
+size_t BasicReceiver<Protocol>::terminatorStraddles() const
+{
+    if (TEXT_PKT_FINISH_LEN < 2) {
+        /* a single byte terminator never straddles chunks */
+        return 0;
+    }
+
+    /* the earliest match is the longest one, shorter ones are those
+     * the matched part ends with */
+    for (size_t matched = _currentPacket.termMatched; matched > 0; --matched) {
+        size_t rest = TEXT_PKT_FINISH_LEN - matched;
+
+        if (0 == memcmp(TEXT_PKT_FINISH + _currentPacket.termMatched - matched,
+                        TEXT_PKT_FINISH, matched) &&
+            ensureDataAvailable(rest) &&
+            0 == memcmp(getData(), TEXT_PKT_FINISH + matched, rest)) {
+            return matched;
+        }
+    }
+
+    return 0;
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::rememberTerminatorMatch()
+{
+    /* the previous match followed by the chunk tail,
+     * TEXT_PKT_FINISH_LEN - 1 bytes at most */
+    char window[TEXT_PKT_FINISH_LEN];
+    size_t tail = std::min(TEXT_PKT_FINISH_LEN - 1, dataAvailable());
+    size_t prefix = std::min(_currentPacket.termMatched, TEXT_PKT_FINISH_LEN - 1 - tail);
+
+    memcpy(window, TEXT_PKT_FINISH + _currentPacket.termMatched - prefix, prefix);
+    memcpy(window + prefix, getData() + dataAvailable() - tail, tail);
+
+    size_t windowLen = prefix + tail;
+    size_t matched = std::min(windowLen, TEXT_PKT_FINISH_LEN - 1);
+
+    for (; matched > 0; --matched) {
+        if (0 == memcmp(window + windowLen - matched, TEXT_PKT_FINISH, matched)) {
+            break;
+        }
+    }
+
+    _currentPacket.termMatched = matched;
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::packetContinueText()
+{
+    size_t matched = terminatorStraddles();
+
+    if (matched) {
+        dataRead(TEXT_PKT_FINISH_LEN - matched);
+
+        if (_currentPacket.streaming) {
+            /* the rest of the bytes held back is packet data */
+            streamFragment(TEXT_PKT_FINISH, _currentPacket.termMatched - matched);
+            streamFinished();
+            return;
+        }
+
+        truncateAssembled(matched);
+        packetFinished(assembledData(), assembled());
+        return;
+    }
+
+    /* every byte of the chunk is scanned exactly once */
+    const char *found = Protocol::findFinish(getData(), dataAvailable());
+
+    if (!found) {
+        if (!_currentPacket.streaming && _streamCallback &&
+            assembled() + dataAvailable() > _streamThreshold) {
+            streamStarted(false);
+        }
+
+        if (_currentPacket.streaming) {
+            streamText();
+            return;
+        }
+
+        // just wait a bit
+        rememberTerminatorMatch();
+        append(dataAvailable());
+        return;
+    }
+
+    size_t size = found - getData();
+
+    if (_currentPacket.streaming) {
+        /* no terminator straddles, all the bytes held back are data */
+        streamFragment(TEXT_PKT_FINISH, _currentPacket.termMatched);
+        streamFragment(getData(), size);
+        dataRead(size + TEXT_PKT_FINISH_LEN);
+        streamFinished();
+        return;
+    }
+
+    if (!assembled()) {
+        /* the whole packet is within the chunk, deliver it in place */
+        const char *data = getData();
+
+        dataRead(size + TEXT_PKT_FINISH_LEN);
+        packetFinished(data, size);
+        return;
+    }
+
+    append(size);
+    dataRead(TEXT_PKT_FINISH_LEN);
+    packetFinished(assembledData(), assembled());
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::packetFinished(const char *data, size_t packetSize)
+{
+    if (PS_BINARY_DATA == _currentPacket.state) {
+        _callback->BinaryPacket(data, packetSize);
+    } else {
+        _callback->TextPacket(data, packetSize);
+    }
+
+    releaseAssembly();
+    _currentPacket.state = PS_NONE;
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::streamStarted(bool binary)
+{
+    _currentPacket.streaming = true;
+    _currentPacket.streamed = 0;
+
+    _streamCallback->PacketBegin(binary, binary ? _currentPacket.packetSize : 0);
+
+    /* the text tail matching the terminator is held back */
+    if (assembled()) {
+        streamFragment(assembledData(), assembled() - _currentPacket.termMatched);
+        releaseAssembly();
+    }
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::streamFragment(const char *data, size_t size)
+{
+    if (size) {
+        _streamCallback->PacketFragment(data, size);
+    }
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::streamFinished()
+{
+    _streamCallback->PacketEnd();
+
+    _currentPacket.streaming = false;
+    _currentPacket.state = PS_NONE;
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::streamBinary()
+{
+    size_t amount = std::min<size_t>(_currentPacket.packetSize - _currentPacket.streamed,
+                                     dataAvailable());
+
+    streamFragment(getData(), amount);
+    dataRead(amount);
+    _currentPacket.streamed += amount;
+
+    if (_currentPacket.streamed < _currentPacket.packetSize) {
+        // just wait a bit
+        return;
+    }
+
+    streamFinished();
+}
+
+template <class Protocol>
+void BasicReceiver<Protocol>::streamText()
+{
+    size_t held = _currentPacket.termMatched;
+    size_t available = dataAvailable();
+
+    rememberTerminatorMatch();
+
+    /* what is held back now is the tail of what was held and the chunk */
+    size_t flushed = held + available - _currentPacket.termMatched;
+    size_t fromHeld = std::min(held, flushed);
+
+    streamFragment(TEXT_PKT_FINISH, fromHeld);
+    streamFragment(getData(), flushed - fromHeld);
+    dataRead(available);
+}
+
+/* instantiated once, in receiver.cpp */
+extern template struct BasicReceiver<IssFraming>;
+
+typedef BasicReceiver<IssFraming> Receiver;
+
 #endif  /* ISS_RECEIVER_H */
@@ -0,0 +1,314 @@
+#include "receiver_pool.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <utility>
+
+ReceiverPool::Shard::Shard()
+: busy(false),
+  stop(false),
+  receivers(sizeof(Receiver)),
+  chunks(0),
+  bytes(0),
+  streamCount(0),
+  errors(0)
+{
+}
+
+ReceiverPool::ReceiverPool(ICallbackFactory* factory, size_t shards, bool pin)
+: _factory(factory),
+  _budget(SIZE_MAX),
+  _sharedBudget(nullptr)
+{
+    if (!shards) {
+        shards = std::thread::hardware_concurrency();
+    }
+
+    if (!shards) {
+        shards = 1;
+    }
+
+    for (size_t idx = 0; idx < shards; ++idx) {
+        _shards.emplace_back(new Shard);
+    }
+
+    size_t cpus = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (size_t idx = 0; idx < shards; ++idx) {
+        Shard &shard = *_shards[idx];
+
+        shard.worker = std::thread(&ReceiverPool::work, this, std::ref(shard), idx % cpus, pin);
+    }
+}
+
+ReceiverPool::~ReceiverPool()
+{
+    for (auto &shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+
+        shard->stop = true;
+        shard->queued.notify_one();
+    }
+
+    for (auto &shard : _shards) {
+        shard->worker.join();
+    }
+}
+
+size_t ReceiverPool::shard(uint64_t streamId) const
+{
+    /* Fibonacci hashing spreads sequential ids evenly */
+    uint64_t hash = streamId * UINT64_C(0x9e3779b97f4a7c15);
+
+    return (hash >> 32) % _shards.size();
+}
+
+ReceiverPool::Shard &ReceiverPool::shardOf(uint64_t streamId)
+{
+    return *_shards[shard(streamId)];
+}
+
+ReceiverPool::ShardStats ReceiverPool::stats(size_t shard) const
+{
+    const Shard &s = *_shards[shard];
+
+    return ShardStats{
+        s.chunks.load(std::memory_order_relaxed),
+        s.bytes.load(std::memory_order_relaxed),
+        s.streamCount.load(std::memory_order_relaxed),
+        s.errors.load(std::memory_order_relaxed)
+    };
+}
+
+void ReceiverPool::Receive(uint64_t streamId, const char *data, unsigned int size)
+{
+    if (size == 0) {
+        return;
+    }
+
+    post(streamId, MT_DATA, data, size);
+}
+
+void ReceiverPool::Close(uint64_t streamId)
+{
+    post(streamId, MT_CLOSE, nullptr, 0);
+}
+
+void ReceiverPool::Drain()
+{
+    for (auto &shard : _shards) {
+        std::unique_lock<std::mutex> lock(shard->mutex);
+
+        shard->drained.wait(lock, [&shard]() {
+            return shard->queue.empty() && !shard->busy;
+        });
+    }
+}
+
+void ReceiverPool::SetMemoryBudget(size_t budget, MemoryBudget* shared)
+{
+    _budget = budget;
+    _sharedBudget = shared;
+}
+
+void ReceiverPool::post(uint64_t streamId, MessageType type, const char *data, size_t size)
+{
+    Shard &shard = shardOf(streamId);
+    Buffer buffer;
+
+    if (size) {
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            buffer = shard.chunkPool.acquire();
+        }
+
+        /* copy outside of the lock not to stall the worker */
+        buffer.append(data, size);
+    }
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    shard.queue.push_back(Message{streamId, type, std::move(buffer)});
+    shard.queued.notify_one();
+}
+
+void ReceiverPool::work(Shard &shard, size_t cpu, bool pin)
+{
+    if (pin) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    std::vector<Message> batch;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(shard.mutex);
+
+            /* give the chunk buffers of the previous batch back */
+            for (auto &message : batch) {
+                shard.chunkPool.release(std::move(message.data));
+            }
+
+            batch.clear();
+
+            if (shard.queue.empty()) {
+                shard.busy = false;
+                shard.drained.notify_all();
+            }
+
+            shard.queued.wait(lock, [&shard]() {
+                return shard.stop || !shard.queue.empty();
+            });
+
+            if (shard.queue.empty()) {
+                // stopped and nothing left
+                break;
+            }
+
+            /* take everything queued at once */
+            batch.swap(shard.queue);
+            shard.busy = true;
+        }
+
+        /* chunks of a stream queued in a row are parsed as one batch */
+        for (size_t idx = 0, next; idx < batch.size(); idx = next) {
+            for (next = idx + 1; next < batch.size(); ++next) {
+                if (MT_DATA != batch[idx].type ||
+                    MT_DATA != batch[next].type ||
+                    batch[idx].streamId != batch[next].streamId) {
+                    break;
+                }
+            }
+
+            try {
+                process(shard, &batch[idx], next - idx);
+            } catch (...) {
+                uint64_t streamId = batch[idx].streamId;
+
+                /* the rest of the stream makes no sense without the failed chunks */
+                if (MT_DATA == batch[idx].type) {
+                    shard.failed.insert(streamId);
+                }
+
+                shard.errors.fetch_add(1, std::memory_order_relaxed);
+                closeSafely(shard, streamId);
+            }
+        }
+    }
+
+    while (!shard.streams.empty()) {
+        if (!closeSafely(shard, shard.streams.begin()->first)) {
+            shard.errors.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    shard.failed.clear();
+}
+
+void ReceiverPool::process(Shard &shard, Message *messages, size_t count)
+{
+    uint64_t streamId = messages[0].streamId;
+
+    if (shard.failed.count(streamId)) {
+        /* StreamClosed has been called already */
+        if (MT_CLOSE == messages[0].type) {
+            shard.failed.erase(streamId);
+        }
+
+        return;
+    }
+
+    if (MT_CLOSE == messages[0].type) {
+        close(shard, streamId);
+        return;
+    }
+
+    auto it = shard.streams.find(streamId);
+
+    if (it == shard.streams.end()) {
+        /* the entry goes first so that close undoes whatever of the rest succeeded */
+        it = shard.streams.emplace(streamId, Stream{nullptr, nullptr}).first;
+        shard.streamCount.fetch_add(1, std::memory_order_relaxed);
+
+        Stream &stream = it->second;
+
+        stream.callback = _factory->StreamOpened(streamId);
+
+        IStreamCallback *streamCallback = dynamic_cast<IStreamCallback *>(stream.callback);
+        void *storage = shard.receivers.allocate();
+
+        if (streamCallback) {
+            stream.receiver = new (storage) Receiver(streamCallback,
+                                                     Receiver::DEFAULT_STREAM_THRESHOLD,
+                                                     &shard.assemblyPool);
+        } else {
+            stream.receiver = new (storage) Receiver(stream.callback, &shard.assemblyPool);
+        }
+
+        stream.receiver->SetMemoryBudget(_budget, _sharedBudget);
+    }
+
+    size_t bytes = 0;
+
+    shard.chunkVector.clear();
+
+    for (Message *message = messages; message < messages + count; ++message) {
+        struct iovec chunk;
+
+        chunk.iov_base = const_cast<char *>(message->data.data());
+        chunk.iov_len = message->data.size();
+        shard.chunkVector.push_back(chunk);
+        bytes += chunk.iov_len;
+    }
+
+    it->second.receiver->ReceiveBatch(shard.chunkVector.data(), count);
+
+    shard.chunks.fetch_add(count, std::memory_order_relaxed);
+    shard.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void ReceiverPool::close(Shard &shard, uint64_t streamId)
+{
+    auto it = shard.streams.find(streamId);
+
+    if (it == shard.streams.end()) {
+        return;
+    }
+
+    Stream stream = it->second;
+
+    shard.streams.erase(it);
+
+    /* either might be missing if opening the stream has thrown */
+    if (stream.receiver) {
+        stream.receiver->~Receiver();
+        shard.receivers.free(stream.receiver);
+    }
+
+    shard.streamCount.fetch_sub(1, std::memory_order_relaxed);
+
+    if (stream.callback) {
+        _factory->StreamClosed(streamId, stream.callback);
+    }
+}
+
+bool ReceiverPool::closeSafely(Shard &shard, uint64_t streamId)
+{
+    try {
+        close(shard, streamId);
+    } catch (...) {
+        /* the stream is gone anyway, StreamClosed itself has thrown */
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,157 @@
+#ifndef ISS_RECEIVER_POOL_H
+#define ISS_RECEIVER_POOL_H 1
+
+#include "iface.h"
+#include "buffer.h"
+#include "receiver.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Many receivers keyed by stream id.
+ *
+ * Streams are sharded by hash of their id among worker threads,
+ * so a stream is always parsed on the same thread, in order,
+ * and its callback is called on that thread. Receivers of a shard
+ * are allocated from the shard slab and share its assembly buffers.
+ * Chunks are copied into buffers recycled by the shard as the data
+ * passed to Receive is only valid during the call.
+ *
+ * An exception thrown while parsing a stream, std::bad_alloc of its
+ * Receiver or anything its callback throws, costs that stream only:
+ * it is closed through StreamClosed, counted in the shard errors and
+ * its chunks are dropped until it is closed with Close.
+ */
+struct ReceiverPool {
+    struct ShardStats {
+        uint64_t chunks;            // chunks parsed
+        uint64_t bytes;             // bytes parsed
+        uint64_t streams;           // streams open
+        uint64_t errors;            // streams closed due to an exception
+    };
+
+private:
+    /************************ types ************************/
+    enum MessageType {
+        MT_DATA     = 0,
+        MT_CLOSE,
+    };
+
+    struct Message {
+        uint64_t streamId;
+        MessageType type;
+        Buffer data;
+    };
+
+    struct Stream {
+        Receiver *receiver;
+        ICallback *callback;
+    };
+
+    struct Shard {
+        /* shared with producers, guarded by mutex */
+        std::mutex mutex;
+        std::condition_variable queued;     // messages arrived or stopping
+        std::condition_variable drained;    // queue is empty and processed
+        std::vector<Message> queue;
+        BufferPool chunkPool;
+        bool busy;
+        bool stop;
+
+        /* owned by the worker */
+        std::thread worker;
+        BufferPool assemblyPool;
+        Slab receivers;
+        std::unordered_map<uint64_t, Stream> streams;
+        std::unordered_set<uint64_t> failed;    // closed upon an exception
+        std::vector<struct iovec> chunkVector;
+
+        std::atomic<uint64_t> chunks;
+        std::atomic<uint64_t> bytes;
+        std::atomic<uint64_t> streamCount;
+        std::atomic<uint64_t> errors;
+
+        Shard();
+    };
+
+    /************************ data ************************/
+    ICallbackFactory* _factory;
+    std::vector<std::unique_ptr<Shard>> _shards;
+    size_t _budget;
+    MemoryBudget* _sharedBudget;
+
+    /************************ methods ************************/
+    Shard &shardOf(uint64_t streamId);
+
+    void work(Shard &shard, size_t cpu, bool pin);
+    /**
+     * Process messages of the same stream, either a single close
+     * or a run of chunks
+     */
+    void process(Shard &shard, Message *messages, size_t count);
+    void close(Shard &shard, uint64_t streamId);
+    /**
+     * close which doesn't let exceptions out
+     * \return \c false if one was thrown
+     */
+    bool closeSafely(Shard &shard, uint64_t streamId);
+
+    void post(uint64_t streamId, MessageType type, const char *data, size_t size);
+
+public:
+    /**
+     * \param shards number of worker threads,
+     *               the number of CPUs if nil
+     * \param pin pin the worker of shard N to CPU N
+     */
+    ReceiverPool(ICallbackFactory* factory, size_t shards = 0, bool pin = false);
+    /**
+     * Parses everything queued so far and closes all the streams
+     */
+    ~ReceiverPool();
+
+    ReceiverPool(const ReceiverPool &) = delete;
+    ReceiverPool &operator=(const ReceiverPool &) = delete;
+
+    /**
+     * Queue a chunk of the stream, opening the stream if needed
+     * \throw std::bad_alloc
+     */
+    void Receive(uint64_t streamId, const char *data, unsigned int size);
+
+    /**
+     * Queue closing of the stream
+     */
+    void Close(uint64_t streamId);
+
+    /**
+     * Wait until everything queued so far is parsed
+     */
+    void Drain();
+
+    /**
+     * Memory budget of the receivers, see Receiver::SetMemoryBudget.
+     * To be set before the first Receive.
+     * \param shared budget of all the streams, may be nil
+     */
+    void SetMemoryBudget(size_t budget, MemoryBudget* shared = nullptr);
+
+    size_t shards() const {
+        return _shards.size();
+    }
+
+    size_t shard(uint64_t streamId) const;
+
+    ShardStats stats(size_t shard) const;
+};
+
+#endif  /* ISS_RECEIVER_POOL_H */
@@ -0,0 +1,119 @@
+#include "search.h"
+
+#include <cstring>
+#include <cstdint>
+
+#if defined(__x86_64__)
+# include <immintrin.h>
+# define HAVE_X86_SEARCH 1
+#endif
+
+typedef const char *(*SearchFunction)(const char *haystack, size_t haystackLen,
+                                      const char *needle, size_t needleLen);
+
+const char *findPatternScalar(const char *haystack, size_t haystackLen,
+                              const char *needle, size_t needleLen)
+{
+    if (haystackLen < needleLen) {
+        return nullptr;
+    }
+
+    const char * const limit = haystack + haystackLen - needleLen + 1;
+
+    for (const char *ptr = haystack; ptr < limit; ++ptr) {
+        ptr = reinterpret_cast<const char *>(memchr(ptr, needle[0], limit - ptr));
+
+        if (!ptr) {
+            return nullptr;
+        }
+
+        if (0 == memcmp(ptr + 1, needle + 1, needleLen - 1)) {
+            return ptr;
+        }
+    }
+
+    return nullptr;
+}
+
+#ifdef HAVE_X86_SEARCH
+static const char *findPatternSse2(const char *haystack, size_t haystackLen,
+                                   const char *needle, size_t needleLen)
+{
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needleLen - 1]);
+    size_t idx = 0;
+
+    for (; idx + needleLen - 1 + 16 <= haystackLen; idx += 16) {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + idx));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + idx + needleLen - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first),
+                                                        _mm_cmpeq_epi8(blockLast, last)));
+
+        while (mask) {
+            size_t bit = __builtin_ctz(mask);
+
+            if (0 == memcmp(haystack + idx + bit + 1, needle + 1, needleLen - 2)) {
+                return haystack + idx + bit;
+            }
+
+            mask &= mask - 1;
+        }
+    }
+
+    return findPatternScalar(haystack + idx, haystackLen - idx, needle, needleLen);
+}
+
+__attribute__((target("avx2")))
+static const char *findPatternAvx2(const char *haystack, size_t haystackLen,
+                                   const char *needle, size_t needleLen)
+{
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needleLen - 1]);
+    size_t idx = 0;
+
+    for (; idx + needleLen - 1 + 32 <= haystackLen; idx += 32) {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(haystack + idx));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(haystack + idx + needleLen - 1));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first),
+                                                              _mm256_cmpeq_epi8(blockLast, last)));
+
+        while (mask) {
+            size_t bit = __builtin_ctz(mask);
+
+            if (0 == memcmp(haystack + idx + bit + 1, needle + 1, needleLen - 2)) {
+                return haystack + idx + bit;
+            }
+
+            mask &= mask - 1;
+        }
+    }
+
+    return findPatternSse2(haystack + idx, haystackLen - idx, needle, needleLen);
+}
+
+static SearchFunction selectSearch()
+{
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports("avx2") ? &findPatternAvx2 : &findPatternSse2;
+}
+#else
+static SearchFunction selectSearch()
+{
+    return &findPatternScalar;
+}
+#endif /* HAVE_X86_SEARCH */
+
+const char *findPattern(const char *haystack, size_t haystackLen,
+                        const char *needle, size_t needleLen)
+{
+    static const SearchFunction search = selectSearch();
+
+    if (needleLen < 2) {
+        return needleLen ?
+            reinterpret_cast<const char *>(memchr(haystack, needle[0], haystackLen)) :
+            haystack;
+    }
+
+    return search(haystack, haystackLen, needle, needleLen);
+}
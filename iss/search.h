@@ -0,0 +1,24 @@
+#ifndef ISS_SEARCH_H
+#define ISS_SEARCH_H 1
+
+#include <cstddef>
+
+/**
+ * Find the first occurrence of needle in haystack.
+ *
+ * Candidates are filtered 16 (SSE2) or 32 (AVX2) positions at once
+ * by comparing the first and the last needle bytes, only those
+ * are compared in full. AVX2 is picked at runtime if CPU supports it.
+ *
+ * \return pointer to the occurrence or nullptr
+ */
+const char *findPattern(const char *haystack, size_t haystackLen,
+                        const char *needle, size_t needleLen);
+
+/**
+ * Scalar version of findPattern, for reference
+ */
+const char *findPatternScalar(const char *haystack, size_t haystackLen,
+                              const char *needle, size_t needleLen);
+
+#endif  /* ISS_SEARCH_H */
@@ -0,0 +1,448 @@
+#include "socket_frontend.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+SocketFrontend::SocketFrontend(ICallbackFactory* factory, size_t readBuffers, size_t readBufferSize)
+: _factory(factory),
+  _budget(SIZE_MAX),
+  _sharedBudget(nullptr),
+  _epollFd(epoll_create1(EPOLL_CLOEXEC)),
+  _wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+  _stop(false),
+  _nextStreamId(0),
+  _accepted(0),
+  _closed(0),
+  _reads(0),
+  _bytes(0),
+  _errors(0)
+{
+    readBuffers = readBuffers ? readBuffers : 1;
+    readBufferSize = readBufferSize ? readBufferSize : 1;
+
+    _readData.resize(readBuffers * readBufferSize);
+
+    for (size_t idx = 0; idx < readBuffers; ++idx) {
+        struct iovec iov;
+
+        iov.iov_base = _readData.data() + idx * readBufferSize;
+        iov.iov_len = readBufferSize;
+        _readVector.push_back(iov);
+    }
+
+    if (valid()) {
+        std::unique_ptr<Endpoint> wakeup(new Endpoint{ET_WAKEUP, _wakeFd, 0, nullptr, nullptr, ""});
+
+        watch(std::move(wakeup));
+    }
+}
+
+SocketFrontend::~SocketFrontend()
+{
+    while (!_endpoints.empty()) {
+        Endpoint &endpoint = *_endpoints.begin()->second;
+        int fd = endpoint.fd;
+
+        if (ET_CONNECTION == endpoint.type) {
+            if (!closeSafely(endpoint)) {
+                _errors.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            continue;
+        }
+
+        if (ET_LISTENER == endpoint.type) {
+            if (!endpoint.path.empty()) {
+                unlink(endpoint.path.c_str());
+            }
+
+            ::close(fd);
+        }
+
+        _endpoints.erase(fd);
+    }
+
+    if (_wakeFd >= 0) {
+        ::close(_wakeFd);
+    }
+
+    if (_epollFd >= 0) {
+        ::close(_epollFd);
+    }
+}
+
+void SocketFrontend::SetMemoryBudget(size_t budget, MemoryBudget* shared)
+{
+    _budget = budget;
+    _sharedBudget = shared;
+}
+
+SocketFrontend::Stats SocketFrontend::stats() const
+{
+    return Stats{
+        _accepted.load(std::memory_order_relaxed),
+        _closed.load(std::memory_order_relaxed),
+        _reads.load(std::memory_order_relaxed),
+        _bytes.load(std::memory_order_relaxed),
+        _errors.load(std::memory_order_relaxed)
+    };
+}
+
+bool SocketFrontend::watch(std::unique_ptr<Endpoint> endpoint)
+{
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = endpoint.get();
+
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, endpoint->fd, &event) < 0) {
+        return false;
+    }
+
+    int fd = endpoint->fd;
+
+    _endpoints[fd] = std::move(endpoint);
+
+    return true;
+}
+
+bool SocketFrontend::listen(int fd, const std::string &path)
+{
+    if (::listen(fd, SOMAXCONN) < 0) {
+        return false;
+    }
+
+    std::unique_ptr<Endpoint> listener(new Endpoint{ET_LISTENER, fd, 0, nullptr, nullptr, path});
+
+    return watch(std::move(listener));
+}
+
+int SocketFrontend::ListenTcp(const char *host, uint16_t port)
+{
+    struct addrinfo hints;
+    struct addrinfo *addresses;
+    std::string service = std::to_string(port);
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    int rc = getaddrinfo(host, service.c_str(), &hints, &addresses);
+
+    if (rc) {
+        errno = EADDRNOTAVAIL;
+        return -1;
+    }
+
+    int fd = -1;
+
+    for (struct addrinfo *address = addresses; address; address = address->ai_next) {
+        fd = socket(address->ai_family,
+                    address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    address->ai_protocol);
+
+        if (fd < 0) {
+            continue;
+        }
+
+        int on = 1;
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        if (0 == bind(fd, address->ai_addr, address->ai_addrlen)) {
+            break;
+        }
+
+        ::close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(addresses);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_storage bound;
+    socklen_t boundLen = sizeof(bound);
+
+    if (getsockname(fd, reinterpret_cast<struct sockaddr *>(&bound), &boundLen) < 0 ||
+        !listen(fd, "")) {
+        int savedErrno = errno;
+
+        ::close(fd);
+        errno = savedErrno;
+        return -1;
+    }
+
+    return ntohs(AF_INET6 == bound.ss_family ?
+                     reinterpret_cast<struct sockaddr_in6 *>(&bound)->sin6_port :
+                     reinterpret_cast<struct sockaddr_in *>(&bound)->sin_port);
+}
+
+bool SocketFrontend::ListenUnix(const char *path)
+{
+    struct sockaddr_un address;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    if (bind(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0) {
+        int savedErrno = errno;
+
+        ::close(fd);
+        errno = savedErrno;
+        return false;
+    }
+
+    if (!listen(fd, path)) {
+        int savedErrno = errno;
+
+        unlink(path);
+        ::close(fd);
+        errno = savedErrno;
+        return false;
+    }
+
+    return true;
+}
+
+bool SocketFrontend::Add(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return false;
+    }
+
+    std::unique_ptr<Endpoint> connection(new Endpoint{ET_CONNECTION, fd, _nextStreamId++,
+                                                      nullptr, nullptr, ""});
+    Endpoint &endpoint = *connection;
+
+    if (!watch(std::move(connection))) {
+        return false;
+    }
+
+    _accepted.fetch_add(1, std::memory_order_relaxed);
+
+    /* watched already, so close undoes whatever of the rest succeeded */
+    try {
+        endpoint.callback = _factory->StreamOpened(endpoint.streamId);
+
+        IStreamCallback *streamCallback = dynamic_cast<IStreamCallback *>(endpoint.callback);
+
+        if (streamCallback) {
+            endpoint.receiver.reset(new Receiver(streamCallback));
+        } else {
+            endpoint.receiver.reset(new Receiver(endpoint.callback));
+        }
+
+        endpoint.receiver->SetMemoryBudget(_budget, _sharedBudget);
+    } catch (...) {
+        _errors.fetch_add(1, std::memory_order_relaxed);
+        closeSafely(endpoint);
+        return true;
+    }
+
+    /* whatever has already arrived raises no edge */
+    serve(endpoint, true);
+
+    return true;
+}
+
+void SocketFrontend::accept(Endpoint &listener)
+{
+    while (true) {
+        int fd = accept4(listener.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0) {
+            if (EINTR == errno || ECONNABORTED == errno) {
+                continue;
+            }
+
+            // EAGAIN: drained, anything else: retried upon the next edge
+            return;
+        }
+
+        if (!Add(fd)) {
+            ::close(fd);
+        }
+    }
+}
+
+bool SocketFrontend::read(Endpoint &connection, bool drain)
+{
+    size_t capacity = _readData.size();
+
+    while (true) {
+        ssize_t readCount = readv(connection.fd, _readVector.data(), _readVector.size());
+
+        if (readCount < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            return EAGAIN == errno || EWOULDBLOCK == errno;
+        }
+
+        if (!readCount) {
+            // closed by peer
+            return false;
+        }
+
+        _reads.fetch_add(1, std::memory_order_relaxed);
+        _bytes.fetch_add(readCount, std::memory_order_relaxed);
+
+        /* parse in place, the buffers are free again once it returns */
+        _filled.clear();
+
+        for (size_t left = readCount, idx = 0; left; ++idx) {
+            struct iovec iov = _readVector[idx];
+
+            iov.iov_len = std::min(iov.iov_len, left);
+            left -= iov.iov_len;
+            _filled.push_back(iov);
+        }
+
+        connection.receiver->ReceiveBatch(_filled.data(), _filled.size());
+
+        if (!drain && static_cast<size_t>(readCount) < capacity) {
+            /* a short read drains the socket, new data raises a new edge */
+            return true;
+        }
+    }
+}
+
+void SocketFrontend::serve(Endpoint &connection, bool drain)
+{
+    bool failed = false;
+    bool open;
+
+    try {
+        open = read(connection, drain);
+    } catch (...) {
+        /* the rest of the stream makes no sense without the failed data */
+        failed = true;
+        open = false;
+    }
+
+    if (!open && !closeSafely(connection)) {
+        failed = true;
+    }
+
+    if (failed) {
+        _errors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void SocketFrontend::close(Endpoint &connection)
+{
+    int fd = connection.fd;
+    uint64_t streamId = connection.streamId;
+    ICallback *callback = connection.callback;
+
+    /* epoll forgets the descriptor once it's closed */
+    ::close(fd);
+    _endpoints.erase(fd);
+    _closed.fetch_add(1, std::memory_order_relaxed);
+
+    /* missing if StreamOpened has thrown */
+    if (callback) {
+        _factory->StreamClosed(streamId, callback);
+    }
+}
+
+bool SocketFrontend::closeSafely(Endpoint &connection)
+{
+    try {
+        close(connection);
+    } catch (...) {
+        /* the connection is gone anyway, StreamClosed itself has thrown */
+        return false;
+    }
+
+    return true;
+}
+
+bool SocketFrontend::Poll(int timeoutMs)
+{
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(_epollFd, events, MAX_EVENTS, timeoutMs);
+
+    if (count < 0) {
+        return EINTR == errno;
+    }
+
+    for (int idx = 0; idx < count; ++idx) {
+        Endpoint &endpoint = *reinterpret_cast<Endpoint *>(events[idx].data.ptr);
+
+        switch (endpoint.type) {
+        case ET_WAKEUP: {
+            uint64_t value;
+
+            while (::read(_wakeFd, &value, sizeof(value)) > 0) {
+            }
+
+            break;
+        }
+        case ET_LISTENER:
+            accept(endpoint);
+            break;
+        case ET_CONNECTION:
+            /* the end of the stream raises no edge of its own if it has
+             * arrived along with the data, read up to it then */
+            serve(endpoint, events[idx].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR));
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool SocketFrontend::Run()
+{
+    while (!_stop.load(std::memory_order_acquire)) {
+        if (!Poll(-1)) {
+            return false;
+        }
+    }
+
+    _stop.store(false, std::memory_order_relaxed);
+
+    return true;
+}
+
+void SocketFrontend::Stop()
+{
+    uint64_t value = 1;
+
+    _stop.store(true, std::memory_order_release);
+
+    while (write(_wakeFd, &value, sizeof(value)) < 0 && EINTR == errno) {
+    }
+}
@@ -0,0 +1,189 @@
+#ifndef ISS_SOCKET_FRONTEND_H
+#define ISS_SOCKET_FRONTEND_H 1
+
+#include "iface.h"
+#include "receiver.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/uio.h>
+
+/**
+ * Socket ingestion for receivers.
+ *
+ * Accepts TCP and UNIX stream connections and serves them with an
+ * edge-triggered epoll loop. Every connection is a stream with its own
+ * Receiver, its callback is taken from ICallbackFactory. Data is read
+ * with a single readv (2) into a set of large buffers and handed to
+ * Receiver::ReceiveBatch, so packets are parsed right in the buffers
+ * the kernel copied into and only the ones straddling reads are copied.
+ *
+ * All the methods but Stop and stats are to be called on the thread
+ * running the loop, callbacks are called on it as well.
+ *
+ * An exception thrown while opening or parsing a connection, by
+ * StreamOpened, std::bad_alloc of its Receiver or anything its callback
+ * throws, costs that connection only: it is closed through StreamClosed
+ * (unless StreamOpened has thrown) and counted in Stats::errors, the
+ * rest of the events are served as usual.
+ */
+struct SocketFrontend {
+    struct Stats {
+        uint64_t accepted;          // connections
+        uint64_t closed;            // connections
+        uint64_t reads;             // readv calls returning data
+        uint64_t bytes;
+        uint64_t errors;            // connections closed due to an exception
+    };
+
+    static const size_t DEFAULT_READ_BUFFERS = 16;
+    static const size_t DEFAULT_READ_BUFFER_SIZE = 64 << 10;
+
+private:
+    /************************ types ************************/
+    enum EndpointType {
+        ET_WAKEUP   = 0,
+        ET_LISTENER,
+        ET_CONNECTION,
+    };
+
+    struct Endpoint {
+        EndpointType type;
+        int fd;
+        uint64_t streamId;
+        ICallback *callback;
+        std::unique_ptr<Receiver> receiver;
+        std::string path;           // UNIX listener to unlink
+    };
+
+    /************************ data ************************/
+    static const int MAX_EVENTS = 64;
+
+    ICallbackFactory* _factory;
+    size_t _budget;
+    MemoryBudget* _sharedBudget;
+    int _epollFd;
+    int _wakeFd;
+    std::atomic<bool> _stop;
+    uint64_t _nextStreamId;
+
+    std::unordered_map<int, std::unique_ptr<Endpoint>> _endpoints;
+
+    std::vector<char> _readData;
+    std::vector<struct iovec> _readVector;      // the whole _readData
+    std::vector<struct iovec> _filled;          // the part of it read
+
+    std::atomic<uint64_t> _accepted;
+    std::atomic<uint64_t> _closed;
+    std::atomic<uint64_t> _reads;
+    std::atomic<uint64_t> _bytes;
+    std::atomic<uint64_t> _errors;
+
+    /************************ methods ************************/
+    bool watch(std::unique_ptr<Endpoint> endpoint);
+    bool listen(int fd, const std::string &path);
+
+    void accept(Endpoint &listener);
+    /**
+     * Read until the socket is drained
+     * \param drain read up to EAGAIN or the end of the stream,
+     *              otherwise a short read is trusted to drain it
+     * \return \c false if the connection is over
+     */
+    bool read(Endpoint &connection, bool drain);
+    /**
+     * read which closes the connection once it's over or has thrown
+     */
+    void serve(Endpoint &connection, bool drain);
+    void close(Endpoint &connection);
+    /**
+     * close which doesn't let exceptions out
+     * \return \c false if one was thrown
+     */
+    bool closeSafely(Endpoint &connection);
+
+public:
+    /**
+     * \param readBuffers buffers filled by a single read
+     * \param readBufferSize size of each of them
+     */
+    SocketFrontend(ICallbackFactory* factory,
+                   size_t readBuffers = DEFAULT_READ_BUFFERS,
+                   size_t readBufferSize = DEFAULT_READ_BUFFER_SIZE);
+    /**
+     * Closes all the connections and listeners
+     */
+    ~SocketFrontend();
+
+    SocketFrontend(const SocketFrontend &) = delete;
+    SocketFrontend &operator=(const SocketFrontend &) = delete;
+
+    /**
+     * \return \c false if epoll couldn't be set up, see errno
+     */
+    bool valid() const {
+        return _epollFd >= 0 && _wakeFd >= 0;
+    }
+
+    /**
+     * Listen for TCP connections
+     * \param host address to bind to, any if nil
+     * \param port port to bind to, an ephemeral one if nil
+     * \return the port bound or -1, see errno
+     */
+    int ListenTcp(const char *host, uint16_t port);
+
+    /**
+     * Listen for UNIX stream connections, the socket file
+     * is removed upon destruction
+     * \return \c false on failure, see errno
+     */
+    bool ListenUnix(const char *path);
+
+    /**
+     * Serve an already connected stream socket, it's closed
+     * along with the connection
+     * \return \c false on failure, see errno, the socket is left
+     *         open then
+     */
+    bool Add(int fd);
+
+    /**
+     * Memory budget of the receivers, see Receiver::SetMemoryBudget,
+     * applies to the connections accepted afterwards
+     * \param shared budget of all the connections, may be nil
+     */
+    void SetMemoryBudget(size_t budget, MemoryBudget* shared = nullptr);
+
+    /**
+     * Wait for events and serve them
+     * \param timeoutMs the same as for epoll_wait (2)
+     * \return \c false on failure, see errno
+     */
+    bool Poll(int timeoutMs);
+
+    /**
+     * Serve events until Stop
+     * \return \c false on failure, see errno
+     */
+    bool Run();
+
+    /**
+     * Make Run return, may be called from any thread
+     */
+    void Stop();
+
+    size_t connections() const {
+        return _accepted.load() - _closed.load();
+    }
+
+    Stats stats() const;
+};
+
+#endif  /* ISS_SOCKET_FRONTEND_H */
@@ -0,0 +1,139 @@
+#include "spill.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+MemoryBudget::MemoryBudget(size_t limit)
+: _limit(limit),
+  _used(0)
+{
+}
+
+bool MemoryBudget::acquire(size_t size)
+{
+    size_t used = _used.load(std::memory_order_relaxed);
+
+    do {
+        if (size > _limit - used) {
+            return false;
+        }
+    } while (!_used.compare_exchange_weak(used, used + size, std::memory_order_relaxed));
+
+    return true;
+}
+
+void MemoryBudget::release(size_t size)
+{
+    _used.fetch_sub(size, std::memory_order_relaxed);
+}
+
+SpillFile::SpillFile()
+: _fd(-1),
+  _size(0),
+  _mapping(nullptr),
+  _mappedSize(0)
+{
+}
+
+SpillFile::~SpillFile()
+{
+    close();
+}
+
+void SpillFile::open()
+{
+    close();
+
+    const char *tmpDir = getenv("TMPDIR");
+    std::string dir = tmpDir && *tmpDir ? tmpDir : "/tmp";
+
+    /* nameless right away if the file system supports it */
+    _fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+
+    if (_fd < 0) {
+        std::string path = dir + "/iss-spill.XXXXXX";
+
+        _fd = mkostemp(&path[0], O_CLOEXEC);
+
+        if (_fd >= 0) {
+            unlink(path.c_str());
+        }
+    }
+
+    if (_fd < 0) {
+        throw std::bad_alloc();
+    }
+}
+
+void SpillFile::append(const char *data, size_t size)
+{
+    while (size) {
+        ssize_t written = pwrite(_fd, data, size, _size);
+
+        if (written < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            throw std::bad_alloc();
+        }
+
+        data += written;
+        size -= written;
+        _size += written;
+    }
+}
+
+const char *SpillFile::map()
+{
+    if (_mapping && _mappedSize == _size) {
+        return reinterpret_cast<const char *>(_mapping);
+    }
+
+    unmap();
+
+    if (!_size) {
+        return "";
+    }
+
+    void *mapping = mmap(nullptr, _size, PROT_READ, MAP_SHARED, _fd, 0);
+
+    if (MAP_FAILED == mapping) {
+        throw std::bad_alloc();
+    }
+
+    /* the callback is most likely to read it through */
+    madvise(mapping, _size, MADV_SEQUENTIAL);
+
+    _mapping = mapping;
+    _mappedSize = _size;
+
+    return reinterpret_cast<const char *>(_mapping);
+}
+
+void SpillFile::unmap()
+{
+    if (_mapping) {
+        munmap(_mapping, _mappedSize);
+        _mapping = nullptr;
+        _mappedSize = 0;
+    }
+}
+
+void SpillFile::close()
+{
+    unmap();
+
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+
+    _size = 0;
+}
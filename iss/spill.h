@@ -0,0 +1,104 @@
+#ifndef ISS_SPILL_H
+#define ISS_SPILL_H 1
+
+#include <cstddef>
+#include <atomic>
+
+/**
+ * Bytes of heap receivers may take to assemble packets, shared
+ * by any number of them on any threads.
+ */
+struct MemoryBudget {
+private:
+    /************************ data ************************/
+    size_t _limit;
+    std::atomic<size_t> _used;
+
+public:
+    explicit MemoryBudget(size_t limit);
+
+    MemoryBudget(const MemoryBudget &) = delete;
+    MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+    /**
+     * \return \c false if it would exceed the limit, nothing is taken then
+     */
+    bool acquire(size_t size);
+
+    void release(size_t size);
+
+    size_t limit() const {
+        return _limit;
+    }
+
+    size_t used() const {
+        return _used.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * Packet assembled in an unlinked temporary file instead of the heap.
+ *
+ * Data is written with pwrite (2), so it's kept in the page cache
+ * the kernel is free to write back and reclaim rather than in the
+ * process memory, and the complete packet is mapped read-only.
+ * The file is created in $TMPDIR, /tmp by default.
+ */
+struct SpillFile {
+private:
+    /************************ data ************************/
+    int _fd;
+    size_t _size;
+    void *_mapping;
+    size_t _mappedSize;
+
+    /************************ methods ************************/
+    void unmap();
+
+public:
+    SpillFile();
+    ~SpillFile();
+
+    SpillFile(const SpillFile &) = delete;
+    SpillFile &operator=(const SpillFile &) = delete;
+
+    bool active() const {
+        return _fd >= 0;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    /**
+     * Create the file, the one open is closed
+     * \throw std::bad_alloc if it couldn't be created
+     */
+    void open();
+
+    /**
+     * Append \c size bytes to the end
+     * \throw std::bad_alloc if the file system is out of space
+     */
+    void append(const char *data, size_t size);
+
+    /**
+     * Drop \c size bytes off the end
+     */
+    void truncate(size_t size) {
+        _size = size < _size ? _size - size : 0;
+    }
+
+    /**
+     * Map the data written so far, valid until the next change
+     * \throw std::bad_alloc if it couldn't be mapped
+     */
+    const char *map();
+
+    /**
+     * Unmap and remove the file
+     */
+    void close();
+};
+
+#endif  /* ISS_SPILL_H */
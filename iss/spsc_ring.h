@@ -0,0 +1,103 @@
+#ifndef ISS_SPSC_RING_H
+#define ISS_SPSC_RING_H 1
+
+#include <cstddef>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+/**
+ * Lock-free ring of fixed capacity for a single producer
+ * and a single consumer thread.
+ *
+ * Slots are move-assigned in and out so that elements owning memory
+ * (e.g. Buffer) keep living in the ring between uses.
+ */
+template <typename T>
+struct SpscRing {
+private:
+    /************************ data ************************/
+    static const size_t CACHE_LINE = 64;
+
+    std::vector<T> _slots;
+    size_t _mask;
+
+    /* padded rather than aligned, new ignores extended alignment before C++17 */
+    char _headPad[CACHE_LINE];
+    std::atomic<size_t> _head;      // consumer position
+    char _tailPad[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> _tail;      // producer position
+    char _endPad[CACHE_LINE - sizeof(std::atomic<size_t>)];
+
+public:
+    /**
+     * \param capacity rounded up to a power of two
+     */
+    explicit SpscRing(size_t capacity)
+    : _head(0),
+      _tail(0)
+    {
+        size_t size = 1;
+
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        _slots.resize(size);
+        _mask = size - 1;
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    size_t capacity() const {
+        return _slots.size();
+    }
+
+    /**
+     * Producer side
+     * \return \c false if the ring is full, \c value is left intact then
+     */
+    bool push(T &&value) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+
+        if (tail - _head.load(std::memory_order_acquire) == _slots.size()) {
+            return false;
+        }
+
+        _slots[tail & _mask] = std::move(value);
+        _tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * Consumer side
+     * \return \c false if the ring is empty
+     */
+    bool pop(T &value) {
+        size_t head = _head.load(std::memory_order_relaxed);
+
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = std::move(_slots[head & _mask]);
+        _head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * Approximate when called concurrently with push or pop
+     */
+    size_t size() const {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+
+    bool empty() const {
+        return !size();
+    }
+};
+
+#endif  /* ISS_SPSC_RING_H */
@@ -11,7 +11,9 @@
 #include <mutex>
 //#include <condition_variable>
 #include <pqxx/pqxx>
+#include <chrono>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <boost/thread/thread.hpp>
 
 // synchronous database access class
@@ -19,11 +21,28 @@
 // singleton class for database requests
 class Database {
 public:
+    // default number of database connections (and db talker threads)
+    static const unsigned DEFAULT_POOL_SIZE = 4;
+
+    // counters of a single db talker thread
+    struct WorkerStats {
+        unsigned long long get_requests;
+        unsigned long long post_requests;
+        unsigned long long delete_requests;
+        unsigned long long bad_requests;
+        // time spent executing requests, in seconds
+        double busy_time;
+    };
+
     // return singleton instance of the database handler
     static Database& getInstance(void);
 
     /*
-     * connect to database and create db talker thread
+     * connect to database with _pool_size connections and create
+     * a db talker thread per connection
+     * _stats_period - seconds between reports of per thread stats,
+     *                 0 disables them, the final ones are reported
+     *                 on Disconnect anyway
      * return true if success, false otherwise or if already connected
      */
     bool Connect(std::string _host,
@@ -31,7 +50,9 @@ public:
                  std::string _username,
                  std::string _password,
                  std::string _db_name,
-                 std::string _table);
+                 std::string _table,
+                 unsigned _pool_size = DEFAULT_POOL_SIZE,
+                 unsigned _stats_period = 0);
     // disconnect from database immidiately
     void Disconnect();
     /*
@@ -39,49 +60,97 @@ public:
      */
     void QueueRequest(DBRequest db_request, async_server::connection_ptr &connection);
 
+    // number of connections (and db talker threads)
+    unsigned PoolSize(void) const;
+    // retrieve counters of db talker thread number _worker
+    WorkerStats GetWorkerStats(unsigned _worker);
+
+protected:
+    /*
+     * database connection and the thread talking through it.
+     * requests to a record (GET, UPDATE and DELETE by id) are always queued
+     * to the same worker, so they are executed in the order they were queued
+     * and a GET sees every write to its id queued before it.
+     * GET of all records and inserts are taken from the shared queue by any
+     * worker, they may run before writes queued earlier to other workers.
+     */
+    struct Worker {
+        unsigned index;
+
+        // database connection
+        std::shared_ptr<pqxx::connection> connection;
+        // result of transaction to database
+        pqxx::result result;
+        // database reply object
+        DBReply dbreply;
+        // database records vector for use with reply object
+        std::shared_ptr<std::vector<std::shared_ptr<DBRecord>>> dbrecords;
+
+        // parallel queues of the requests to ids owned by this worker,
+        // guarded by m_queue_mutex
+        std::queue<DBRequest> request_queue;
+        std::queue<async_server::connection_ptr> connection_queue;
+
+        // guarded by m_queue_mutex
+        WorkerStats stats;
+        std::chrono::steady_clock::time_point last_report;
+
+        // thread to talk with database
+        boost::thread thread;
+    };
+
     /*
      * thread to process queued requests
      */
-    void DoRequest(void);
+    void DoRequest(Worker *worker);
 
-protected:
     // explicitly do POST request
-    void DoPostRequest(PostRequest *post_request);
+    void DoPostRequest(Worker *worker, PostRequest *post_request);
     // explicitly do DELETE request
-    void DoDeleteRequest(DeleteRequest *delete_request);
+    void DoDeleteRequest(Worker *worker, DeleteRequest *delete_request);
     // explicitly do GET request
-    void DoGetRequest(GetRequest *get_request);
+    void DoGetRequest(Worker *worker, GetRequest *get_request);
     // explicitly do request
-    void Request(std::string request_string);
+    void Request(Worker *worker, std::string request_string);
+
+    // worker to execute the request to a record in order or NULL if any will do
+    Worker *RequestOwner(const DBRequest &db_request);
+    // reply to GET request with records of the cache
+    void ReplyFromCache(Worker *worker,
+                        Cache<bigserial_t, std::shared_ptr<DBRecord>> &cache,
+                        bigserial_t id);
+    // drop the cache after a write is commited
+    void InvalidateCache(void);
+    // print the worker counters, m_queue_mutex should be locked
+    void ReportStats(Worker *worker);
+    // report the counters if the stats period has passed since the last time,
+    // return time left till the next report
+    std::chrono::steady_clock::duration ReportStatsIfDue(Worker *worker);
 
     bool m_connected;
 
     std::string m_table;
 
-    // database reply object
-    DBReply m_dbreply;
-    // database records vector for use with reply object
-    std::shared_ptr<std::vector<std::shared_ptr<DBRecord>>> m_dbrecords;
     // cache object
     Cache<bigserial_t, std::shared_ptr<DBRecord>> m_cache;
+    // incremented on every invalidation, so that a select which has been
+    // running while a write was commited does not refill the cache
+    unsigned long long m_cache_generation;
+    // shared for lookups, exclusive to fill or invalidate the cache
+    boost::shared_mutex m_cache_mutex;
 
-    // db thread mutex
-    //std::mutex m_db_thread_mutex;
-    // condition variable for database thread
+    // condition variable for database threads
     boost::condition_variable m_db_thread_cv;
-    // parallel queues for request and connection_objects
+    // parallel queues for request and connection_objects any worker may take
     std::queue<DBRequest> m_request_queue;
     std::queue<async_server::connection_ptr> m_connection_queue;
     // mutex for request and connection queues
     boost::mutex m_queue_mutex;
 
-    // database connection
-    std::shared_ptr<pqxx::connection> m_connection;
-    // result of transaction to database
-    pqxx::result m_result;
-
-    // thread to talk with database
-    boost::thread m_db_thread;
+    // connections with their threads
+    std::vector<std::shared_ptr<Worker>> m_workers;
+    // seconds between stats reports, 0 if disabled
+    unsigned m_stats_period;
 
 private:
     // as a singleton - no construction from outside, no copy
@@ -1,6 +1,7 @@
 #include "Server.hpp"
 #include "Database.hpp"
 #include <iostream>
+#include <cstdlib>
 
 int main(int argc, char **argv)
 {
@@ -8,6 +9,7 @@ int main(int argc, char **argv)
         std::cout << "usage: " << argv[0]
                   << " host port username password"
                   << " database-name table-name server-host server-port"
+                  << " [db-pool-size [db-stats-period]]"
                   << std::endl;
         exit(0);
     }
@@ -19,6 +21,10 @@ int main(int argc, char **argv)
                 _table_name = argv[6],
                 _s_host = argv[7],
                 _s_port = argv[8];
+    // number of database connections and seconds between their stats reports
+    unsigned _pool_size = argc > 9 ? strtoul(argv[9], NULL, 10)
+                                   : Database::DEFAULT_POOL_SIZE,
+             _stats_period = argc > 10 ? strtoul(argv[10], NULL, 10) : 0;
     try {
         bool res =
             Database::getInstance().Connect(
@@ -27,7 +33,9 @@ int main(int argc, char **argv)
                                             _username,
                                             _password,
                                             _db_name,
-                                            _table_name
+                                            _table_name,
+                                            _pool_size,
+                                            _stats_period
                                         );
         if (!res) {
             std::cout << "Cannot connect to database:\n"
@@ -36,7 +44,8 @@ int main(int argc, char **argv)
                       << "\tusername - " << _username << "\n"
                       << "\tpassword - " << _password << "\n"
                       << "\t_db_name - " << _db_name << "\n"
-                      << "\t_table_name - " << _table_name << "\n";
+                      << "\t_table_name - " << _table_name << "\n"
+                      << "\tpool size - " << _pool_size << "\n";
             return 1;
         }
 
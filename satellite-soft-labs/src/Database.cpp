@@ -8,14 +8,23 @@
 #include <mutex>
 #include <condition_variable>
 #include <pqxx/pqxx>
+#include <chrono>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
 #include <boost/thread/thread.hpp>
 
+// definition for odr-use of the in-class initialized constant
+const unsigned Database::DEFAULT_POOL_SIZE;
+
 // constructor
 Database::Database()
 {
     // we're not connected initialy to any database
     m_connected = false;
+    m_cache_generation = 0;
+    m_stats_period = 0;
 }
 
 Database::Database(Database const&)
@@ -40,11 +49,14 @@ Database::Connect(std::string _host,
                   std::string _username,
                   std::string _password,
                   std::string _db_name,
-                  std::string _table)
+                  std::string _table,
+                  unsigned _pool_size,
+                  unsigned _stats_period)
 {
     std::string connection_string = "";
 
     if (m_connected) return false;
+    if (_pool_size == 0) _pool_size = 1;
 
     // generate connection string
     if (!_host.empty()) connection_string.append("host="+_host+" ");
@@ -53,23 +65,35 @@ Database::Connect(std::string _host,
     if (!_password.empty()) connection_string.append("password="+_password+" ");
     if (!_db_name.empty()) connection_string.append("dbname="+_db_name+" ");
 
+    // open all the connections before any thread is started
     try {
-        m_connection.reset(new pqxx::connection(connection_string));
+        for (unsigned i = 0; i < _pool_size; ++i) {
+            std::shared_ptr<Worker> worker(new Worker);
+            worker->index = i;
+            worker->connection.reset(new pqxx::connection(connection_string));
+            worker->stats = WorkerStats();
+            worker->last_report = std::chrono::steady_clock::now();
+            m_workers.push_back(worker);
+        }
     }
     catch (std::exception &e) {
         printf("%s\n", e.what());
+        m_workers.clear();
         return false;
     }
 
     // remember table name
     m_table = _table;
+    m_stats_period = _stats_period;
     m_connected = true;
 
     // initialize cache - set it invalid only
     m_cache.SetInvalid();
 
-    // create db_thread
-    m_db_thread = boost::thread(&Database::DoRequest, this);
+    // create db threads
+    for (unsigned i = 0; i < m_workers.size(); ++i)
+        m_workers[i]->thread = boost::thread(&Database::DoRequest, this,
+                                             m_workers[i].get());
 
     return true;
 }
@@ -77,25 +101,71 @@ Database::Connect(std::string _host,
 void
 Database::Disconnect()
 {
-    m_db_thread.interrupt();
-    m_db_thread.join();
+    for (unsigned i = 0; i < m_workers.size(); ++i)
+        m_workers[i]->thread.interrupt();
+    for (unsigned i = 0; i < m_workers.size(); ++i)
+        m_workers[i]->thread.join();
     boost::unique_lock<boost::mutex> scoped_lock(m_queue_mutex);
+    // final stats
+    for (unsigned i = 0; i < m_workers.size(); ++i)
+        ReportStats(m_workers[i].get());
     // we do disconnect here
     m_connected = false;
-    m_connection.reset();
+    m_workers.clear();
     // force connection and request queue to empty
     while (!m_connection_queue.empty()) m_connection_queue.pop();
     while (!m_request_queue.empty()) m_request_queue.pop();
 }
 
+unsigned
+Database::PoolSize(void) const
+{
+    return m_workers.size();
+}
+
+Database::WorkerStats
+Database::GetWorkerStats(unsigned _worker)
+{
+    boost::unique_lock<boost::mutex> scoped_lock(m_queue_mutex);
+    return m_workers.at(_worker)->stats;
+}
+
+void
+Database::ReportStats(Worker *worker)
+{
+    printf("db worker %u: %llu get, %llu post, %llu delete, %llu bad, "
+           "busy %.3f s, %u queued\n",
+           worker->index,
+           worker->stats.get_requests,
+           worker->stats.post_requests,
+           worker->stats.delete_requests,
+           worker->stats.bad_requests,
+           worker->stats.busy_time,
+           (unsigned)worker->request_queue.size());
+    worker->last_report = std::chrono::steady_clock::now();
+}
+
+std::chrono::steady_clock::duration
+Database::ReportStatsIfDue(Worker *worker)
+{
+    std::chrono::steady_clock::duration period = std::chrono::seconds(m_stats_period);
+    std::chrono::steady_clock::duration elapsed =
+            std::chrono::steady_clock::now() - worker->last_report;
+
+    if (elapsed < period) return period - elapsed;
+
+    ReportStats(worker);
+    return period;
+}
+
 void
-Database::Request(std::string request_string)
+Database::Request(Worker *worker, std::string request_string)
 {
     // create transaction to execute and commit
-    pqxx::work transaction(*m_connection, request_string);
+    pqxx::work transaction(*worker->connection, request_string);
 
     try {
-        m_result = transaction.exec(request_string);
+        worker->result = transaction.exec(request_string);
     }
     catch (pqxx::pqxx_exception &e) {
         printf("pqxx exception: %s\n", e.base().what());
@@ -107,6 +177,14 @@ Database::Request(std::string request_string)
     transaction.commit();
 }
 
+void
+Database::InvalidateCache(void)
+{
+    boost::unique_lock<boost::shared_mutex> cache_lock(m_cache_mutex);
+    m_cache.SetInvalid();
+    ++m_cache_generation;
+}
+
 // free those strings from post request
 void finalize_request_arguments(char *f_name, char *l_name, char *b_date)
 {
@@ -116,7 +194,7 @@ void finalize_request_arguments(char *f_name, char *l_name, char *b_date)
 }
 
 void
-Database::DoPostRequest(PostRequest *post_request)
+Database::DoPostRequest(Worker *worker, PostRequest *post_request)
 {
     std::string request_string("");
     bigserial_t id = post_request->id;
@@ -125,11 +203,11 @@ Database::DoPostRequest(PostRequest *post_request)
          *birth_date = post_request->birth_date;
 
     // reply will not have any records supplied
-    m_dbrecords->clear();
+    worker->dbrecords->clear();
 
     // check if request is valid
     if (!first_name || !last_name || !birth_date) {
-        m_dbreply.SetKind(REPLY_BAD_REQUEST);
+        worker->dbreply.SetKind(REPLY_BAD_REQUEST);
         finalize_request_arguments(first_name, last_name, birth_date);
         return;
     }
@@ -162,31 +240,31 @@ Database::DoPostRequest(PostRequest *post_request)
         request_string.append("');");
     }
 
-    m_cache.SetInvalid();
-    Request(request_string);
+    Request(worker, request_string);
+    // invalidate only after the commit: a select of another worker
+    // might have refilled the cache in between otherwise
+    InvalidateCache();
     // it was either update or insert
-    m_dbreply.SetKind(m_result.affected_rows() > 0 ? REPLY_OK : REPLY_NOT_FOUND);
+    worker->dbreply.SetKind(worker->result.affected_rows() > 0 ? REPLY_OK : REPLY_NOT_FOUND);
     finalize_request_arguments(first_name, last_name, birth_date);
 }
 
 void
-Database::DoDeleteRequest(DeleteRequest *delete_request)
+Database::DoDeleteRequest(Worker *worker, DeleteRequest *delete_request)
 {
     std::string request_string("");
     bigserial_t id = delete_request->id;
-    bool found;
 
-    m_dbrecords->clear();
+    worker->dbrecords->clear();
 
     // check if request is valid
     if (id == 0) {
-        m_dbreply.SetKind(REPLY_BAD_REQUEST);
+        worker->dbreply.SetKind(REPLY_BAD_REQUEST);
         return;
     }
 
     // do the request
-    m_dbreply.SetKind(REPLY_OK);
-    m_cache.SetInvalid();
+    worker->dbreply.SetKind(REPLY_OK);
     // DELETE /users/173
     request_string.append("DELETE FROM ");
     request_string.append(m_table);
@@ -194,60 +272,112 @@ Database::DoDeleteRequest(DeleteRequest *delete_request)
     request_string.append(std::to_string(id));
     request_string.append(";");
 
-    Request(request_string);
+    Request(worker, request_string);
+    InvalidateCache();
     // it was delete
-    m_dbreply.SetKind(m_result.affected_rows() > 0 ? REPLY_OK : REPLY_NOT_FOUND);
+    worker->dbreply.SetKind(worker->result.affected_rows() > 0 ? REPLY_OK : REPLY_NOT_FOUND);
 }
 
 void
-Database::DoGetRequest(GetRequest *get_request)
+Database::ReplyFromCache(Worker *worker,
+                         Cache<bigserial_t, std::shared_ptr<DBRecord>> &cache,
+                         bigserial_t id)
 {
-    std::string request_string("");
-    bigserial_t id = get_request->id;
-
-    // check if cache is valid
-    if (!m_cache.Valid()) {
-        // renew cache
-        request_string.append("SELECT id, first_name, last_name, birth_date FROM ");
-        request_string.append(m_table);
-        request_string.append(";");
-        Request(request_string);
-
-        // copy result of the select to cache
-        for (pqxx::result::const_iterator it = m_result.begin();
-             it != m_result.end();
-             ++it) {
-            std::shared_ptr<DBRecord> record;
-            record.reset(new DBRecord);
-            record->id = it["id"].as<int>();
-            record->first_name = it["first_name"].as<std::string>();
-            record->last_name = it["last_name"].as<std::string>();
-            record->birth_date = it["birth_date"].as<std::string>();
-            m_cache.AddValue(record->id, record);
-        }
-        // set cache valid
-        m_cache.SetInvalid(false);
-    }
+    worker->dbrecords->clear();
 
-    // now we only do get requests with cache
     if (id > 0) {
         // id provided
         bool found;
-        std::shared_ptr<DBRecord> element = m_cache.FindValue(id, &found);
-        m_dbrecords->clear();
-        if (found) {//element.get()) {
-            m_dbrecords->push_back(element);
-            m_dbreply.SetKind(REPLY_OK);
+        std::shared_ptr<DBRecord> element = cache.FindValue(id, &found);
+        if (found) {
+            worker->dbrecords->push_back(element);
+            worker->dbreply.SetKind(REPLY_OK);
         } else {
-            m_dbreply.SetKind(REPLY_NOT_FOUND);
+            worker->dbreply.SetKind(REPLY_NOT_FOUND);
         }
     } else {
-        const std::vector<std::shared_ptr<DBRecord>>& res = m_cache.CachedValues();
+        const std::vector<std::shared_ptr<DBRecord>>& res = cache.CachedValues();
         // should copy from cached records due to cache invalidation
         // in between to requests
-        m_dbrecords->clear();
-        m_dbrecords->assign(res.begin(), res.end());
+        worker->dbrecords->assign(res.begin(), res.end());
+        worker->dbreply.SetKind(REPLY_OK);
+    }
+}
+
+void
+Database::DoGetRequest(Worker *worker, GetRequest *get_request)
+{
+    std::string request_string("");
+    bigserial_t id = get_request->id;
+    unsigned long long generation;
+
+    // check if cache is valid, lookups of all the workers go in parallel
+    {
+        boost::shared_lock<boost::shared_mutex> cache_lock(m_cache_mutex);
+        if (m_cache.Valid()) {
+            ReplyFromCache(worker, m_cache, id);
+            return;
+        }
+        generation = m_cache_generation;
+    }
+
+    // renew cache, the select runs unlocked
+    request_string.append("SELECT id, first_name, last_name, birth_date FROM ");
+    request_string.append(m_table);
+    request_string.append(";");
+    Request(worker, request_string);
+
+    // copy result of the select
+    Cache<bigserial_t, std::shared_ptr<DBRecord>> fetched;
+    fetched.SetInvalid();
+    for (pqxx::result::const_iterator it = worker->result.begin();
+         it != worker->result.end();
+         ++it) {
+        std::shared_ptr<DBRecord> record;
+        record.reset(new DBRecord);
+        record->id = it["id"].as<int>();
+        record->first_name = it["first_name"].as<std::string>();
+        record->last_name = it["last_name"].as<std::string>();
+        record->birth_date = it["birth_date"].as<std::string>();
+        fetched.AddValue(record->id, record);
+    }
+    fetched.SetInvalid(false);
+
+    boost::unique_lock<boost::shared_mutex> cache_lock(m_cache_mutex);
+    if (generation != m_cache_generation) {
+        // a write was commited during the select, the result is still
+        // the answer to this request but must not get to the cache
+        ReplyFromCache(worker, fetched, id);
+        return;
+    }
+    // another worker may have renewed it meanwhile
+    if (!m_cache.Valid())
+        m_cache = fetched;
+    ReplyFromCache(worker, m_cache, id);
+}
+
+Database::Worker *
+Database::RequestOwner(const DBRequest &db_request)
+{
+    bigserial_t id = 0;
+
+    switch (db_request.request_type) {
+        case REQUEST_GET:
+            id = db_request.any_request.get_request.id;
+            break;
+        case REQUEST_POST:
+            id = db_request.any_request.post_request.id;
+            break;
+        case REQUEST_DELETE:
+            id = db_request.any_request.delete_request.id;
+            break;
+        default:
+            break;
     }
+
+    // GET of all records, inserts and bad requests have no record to follow
+    if (id == 0 || m_workers.empty()) return NULL;
+    return m_workers[id % m_workers.size()].get();
 }
 
 void
@@ -256,69 +386,115 @@ Database::QueueRequest(DBRequest db_request, async_server::connection_ptr &conne
     // lock mutex
     boost::unique_lock<boost::mutex> scoped_lock(m_queue_mutex);
     // add request and connection object to queues
-    m_request_queue.push(db_request);
-    m_connection_queue.push(async_server::connection_ptr(connection));
-    // notify m_db_thread
+    Worker *owner = RequestOwner(db_request);
+    if (owner) {
+        owner->request_queue.push(db_request);
+        owner->connection_queue.push(async_server::connection_ptr(connection));
+    } else {
+        m_request_queue.push(db_request);
+        m_connection_queue.push(async_server::connection_ptr(connection));
+    }
+    // notify db threads, the owner is not known to the cv
     m_db_thread_cv.notify_all();
     // unlock mutex
 }
 
 void
-Database::DoRequest(void)
+Database::DoRequest(Worker *worker)
 {
     boost::unique_lock<boost::mutex> scoped_lock(m_queue_mutex);
-    //std::unique_lock<std::mutex> locker(m_db_thread_mutex);
     while (m_connected && !boost::this_thread::interruption_requested()) {
-        // wait for notification to do some requests
-        m_db_thread_cv.wait(scoped_lock, [&](){
-            //boost::unique_lock<boost::mutex> sl(m_queue_mutex);
-            return !m_request_queue.empty() ||
+        auto pending = [&](){
+            return !worker->request_queue.empty() ||
+                   !m_request_queue.empty() ||
                    !m_connected ||
                    boost::this_thread::interruption_requested();
-        });
+        };
+
+        // wait for notification to do some requests,
+        // an idle worker wakes up for its stats reports too
+        if (m_stats_period) {
+            long long timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    ReportStatsIfDue(worker)).count();
+            m_db_thread_cv.timed_wait(scoped_lock,
+                                      boost::posix_time::milliseconds(timeout + 1),
+                                      pending);
+            ReportStatsIfDue(worker);
+        } else {
+            m_db_thread_cv.wait(scoped_lock, pending);
+        }
         DBRequest request;
         async_server::connection_ptr co;
 
         // queue mutex is still locked at this point
-        while (!m_request_queue.empty() &&
-               m_connected &&
+        while (m_connected &&
                !boost::this_thread::interruption_requested()) {
+            // requests owned by this worker go first, they may be
+            // taken by no one else
+            std::queue<DBRequest> *request_queue = &worker->request_queue;
+            std::queue<async_server::connection_ptr> *connection_queue =
+                    &worker->connection_queue;
+            if (request_queue->empty()) {
+                request_queue = &m_request_queue;
+                connection_queue = &m_connection_queue;
+            }
+            if (request_queue->empty()) break;
+
             // retrieve request structure and connection_object
-            request = m_request_queue.front();
-            m_request_queue.pop();
-            co = m_connection_queue.front();
-            m_connection_queue.pop();
+            request = request_queue->front();
+            request_queue->pop();
+            co = connection_queue->front();
+            connection_queue->pop();
 
             // we don't need the lock anymore
             scoped_lock.unlock();
 
-            m_dbrecords.reset(new std::vector<std::shared_ptr<DBRecord>>);
+            std::chrono::steady_clock::time_point started =
+                    std::chrono::steady_clock::now();
+            worker->dbrecords.reset(new std::vector<std::shared_ptr<DBRecord>>);
 
             // execute the request
             switch (request.request_type) {
                 case REQUEST_GET:
-                    DoGetRequest(&(request.any_request.get_request));
-                    // this request reply is already in m_dbrecords
+                    DoGetRequest(worker, &(request.any_request.get_request));
+                    // this request reply is already in worker->dbrecords
                     break;
                 case REQUEST_POST:
-                    DoPostRequest(&(request.any_request.post_request));
+                    DoPostRequest(worker, &(request.any_request.post_request));
                     break;
                 case REQUEST_DELETE:
-                    DoDeleteRequest(&(request.any_request.delete_request));
+                    DoDeleteRequest(worker, &(request.any_request.delete_request));
                     break;
                 default:
-                    m_dbrecords->clear();
-                    m_dbreply.SetKind(REPLY_BAD_REQUEST);
+                    worker->dbrecords->clear();
+                    worker->dbreply.SetKind(REPLY_BAD_REQUEST);
                     break;
             }
 
             // launch thread to reply to client
-            //threadPool.post(boost::bind(&Server::ReplyToClient, ServerInstance, &m_dbreply, async_server::connection_ptr));
-            m_dbreply.SetRecords(m_dbrecords);
-            threadPool->post(boost::bind(ServerSendReply, m_dbreply, co));
+            worker->dbreply.SetRecords(worker->dbrecords);
+            threadPool->post(boost::bind(ServerSendReply, worker->dbreply, co));
+
+            std::chrono::steady_clock::time_point finished =
+                    std::chrono::steady_clock::now();
 
             // lock queue mutex
             scoped_lock.lock();
+
+            // update stats
+            worker->stats.busy_time +=
+                    std::chrono::duration<double>(finished - started).count();
+            if (worker->dbreply.Kind() == REPLY_BAD_REQUEST)
+                ++worker->stats.bad_requests;
+            else if (request.request_type == REQUEST_GET)
+                ++worker->stats.get_requests;
+            else if (request.request_type == REQUEST_POST)
+                ++worker->stats.post_requests;
+            else
+                ++worker->stats.delete_requests;
+
+            if (m_stats_period)
+                ReportStatsIfDue(worker);
         }
     }
 }